@@ -0,0 +1,298 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "opencv2/imgproc.hpp"
+#include <algorithm>
+#include <fstream>
+#include "Evaluator.h"
+
+
+namespace ghalgo
+{
+    Evaluator::Evaluator()
+    {
+    }
+
+
+    Evaluator::~Evaluator()
+    {
+    }
+
+
+    bool Evaluator::add_template(const std::string& rsname, const cv::Mat& rimg)
+    {
+        bool result = false;
+        if ((rimg.type() == CV_8UC1) && !rimg.empty())
+        {
+            m_template_names.push_back(rsname);
+            m_templates.push_back(rimg.clone());
+            result = true;
+        }
+        return result;
+    }
+
+
+    bool Evaluator::add_scene(const cv::Mat& rimg, const std::vector<ScenePose>& rvposes)
+    {
+        bool result = false;
+        if ((rimg.type() == CV_8UC1) && !rimg.empty())
+        {
+            m_scenes.push_back(rimg.clone());
+            m_scene_poses.push_back(rvposes);
+            result = true;
+        }
+        return result;
+    }
+
+
+    void Evaluator::evaluate(
+        const EvalGrid& rgrid,
+        const TemplateParams& rparams,
+        const int loopstep,
+        EvalResult& rresult) const
+    {
+        const int MAX_PEAKS = 16;
+
+        // score of every peak kept for the ROC curve and whether it was at a template instance
+        std::vector<std::pair<double, bool>> vpeaks;
+        int nposes = 0;
+        int nfound = 0;
+        int nfalse = 0;
+        double dist_sum = 0.0;
+        int64_t ticks = 0;
+
+        rresult = EvalResult();
+        rresult.params = rparams;
+        rresult.loopstep = loopstep;
+
+        MatcherContext ctx;
+        for (size_t k = 0; k < m_templates.size(); ++k)
+        {
+            cv::Mat img_pre;
+            cv::Mat img_key;
+            GradientMatcher::pre_process(rparams, m_templates[k], img_pre);
+            GradientMatcher::create_masked_gradient_orientation_img(rparams, ctx, img_pre, img_key);
+            const CompiledTemplate ctemplate(rparams, img_key);
+
+            // peaks closer together than the hit distance are treated as the same peak
+            const double max_dist = std::max(2.0, rgrid.max_dist_ratio * std::min(img_key.cols, img_key.rows));
+            const int peak_radius = static_cast<int>(max_dist);
+            const double score_scale = static_cast<double>(loopstep * loopstep) / std::max(1.0, ctemplate.max_votes);
+
+            for (size_t s = 0; s < m_scenes.size(); ++s)
+            {
+                cv::Mat img_scene;
+                cv::Mat img_grad;
+                cv::Mat img_match;
+                int64_t t0 = cv::getTickCount();
+                GradientMatcher::pre_process(rparams, m_scenes[s], img_scene);
+                GradientMatcher::apply_ghough(ctemplate, ctx, img_scene, img_grad, img_match, loopstep);
+                int64_t t1 = cv::getTickCount();
+                ticks += (t1 - t0);
+
+                // instances of this template in the scene
+                std::vector<const ScenePose *> vtargets;
+                for (const auto& rpose : m_scene_poses[s])
+                {
+                    if (rpose.name == m_template_names[k])
+                    {
+                        vtargets.push_back(&rpose);
+                    }
+                }
+                std::vector<bool> vused(vtargets.size(), false);
+                nposes += static_cast<int>(vtargets.size());
+
+                // take peaks from highest to lowest and blank out the area around each one
+                bool is_done = false;
+                cv::Mat mask = cv::Mat::ones(img_match.size(), CV_8U);
+                for (int n = 0; (n < MAX_PEAKS) && !is_done; ++n)
+                {
+                    double qmax;
+                    cv::Point ptmax;
+                    cv::minMaxLoc(img_match, nullptr, &qmax, nullptr, &ptmax, mask);
+                    const double score = qmax * score_scale;
+                    if (score >= rgrid.roc_min_score)
+                    {
+                        cv::circle(mask, ptmax, peak_radius, cv::Scalar(0), -1);
+
+                        // a peak is a hit if it is close to an instance that has not been hit yet
+                        int nbest = -1;
+                        double best_dist = max_dist;
+                        for (size_t j = 0; j < vtargets.size(); ++j)
+                        {
+                            const cv::Point ptdiff = ptmax - vtargets[j]->center;
+                            const double dist = std::sqrt(static_cast<double>(ptdiff.x * ptdiff.x + ptdiff.y * ptdiff.y));
+                            if (!vused[j] && (dist <= best_dist))
+                            {
+                                nbest = static_cast<int>(j);
+                                best_dist = dist;
+                            }
+                        }
+
+                        const bool is_hit = (nbest >= 0);
+                        vpeaks.push_back({ score, is_hit });
+                        if (is_hit)
+                        {
+                            vused[nbest] = true;
+                        }
+                        if (score >= rgrid.min_score)
+                        {
+                            nfound += (is_hit) ? 1 : 0;
+                            nfalse += (is_hit) ? 0 : 1;
+                            dist_sum += (is_hit) ? best_dist : 0.0;
+                        }
+                    }
+                    else
+                    {
+                        is_done = true;
+                    }
+                }
+            }
+        }
+
+        const double nframes = static_cast<double>(std::max<size_t>(1, m_scenes.size()));
+        rresult.detection_rate = (nposes > 0) ? (static_cast<double>(nfound) / nposes) : 0.0;
+        rresult.loc_error = (nfound > 0) ? (dist_sum / nfound) : 0.0;
+        rresult.fp_per_frame = nfalse / nframes;
+        rresult.msec_per_frame = ((1000.0 * ticks) / cv::getTickFrequency()) / nframes;
+
+        // lower the threshold one peak at a time and add a point each time the score changes
+        std::sort(vpeaks.begin(), vpeaks.end(),
+            [](const std::pair<double, bool>& a, const std::pair<double, bool>& b) { return a.first > b.first; });
+        int nhits = 0;
+        int nmisses = 0;
+        for (size_t n = 0; n < vpeaks.size(); ++n)
+        {
+            nhits += (vpeaks[n].second) ? 1 : 0;
+            nmisses += (vpeaks[n].second) ? 0 : 1;
+            if (((n + 1) == vpeaks.size()) || (vpeaks[n + 1].first != vpeaks[n].first))
+            {
+                RocPoint pt;
+                pt.score = vpeaks[n].first;
+                pt.detection_rate = (nposes > 0) ? (static_cast<double>(nhits) / nposes) : 0.0;
+                pt.fp_per_frame = nmisses / nframes;
+                rresult.roc.push_back(pt);
+            }
+        }
+    }
+
+
+    void Evaluator::evaluate_grid(
+        const EvalGrid& rgrid,
+        std::vector<EvalResult>& rvresults,
+        const std::function<void(const EvalResult&)>& rfunc) const
+    {
+        for (const int loopstep : rgrid.loopsteps)
+        {
+            for (const int kpreblur : rgrid.preblurs)
+            {
+                for (const int ksobel : rgrid.sobels)
+                {
+                    for (const double angstep : rgrid.angsteps)
+                    {
+                        for (const double magthr : rgrid.magthrs)
+                        {
+                            EvalResult result;
+                            evaluate(rgrid, TemplateParams(kpreblur, ksobel, magthr, angstep), loopstep, result);
+                            rvresults.push_back(result);
+                            if (rfunc)
+                            {
+                                rfunc(result);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        mark_pareto_front(rvresults);
+    }
+
+
+    void mark_pareto_front(std::vector<EvalResult>& rvresults)
+    {
+        for (auto& rresult : rvresults)
+        {
+            rresult.is_pareto = true;
+            for (const auto& rother : rvresults)
+            {
+                const bool is_no_worse =
+                    (rother.detection_rate >= rresult.detection_rate) &&
+                    (rother.fp_per_frame <= rresult.fp_per_frame) &&
+                    (rother.msec_per_frame <= rresult.msec_per_frame);
+                const bool is_better =
+                    (rother.detection_rate > rresult.detection_rate) ||
+                    (rother.fp_per_frame < rresult.fp_per_frame) ||
+                    (rother.msec_per_frame < rresult.msec_per_frame);
+                if (is_no_worse && is_better)
+                {
+                    rresult.is_pareto = false;
+                }
+            }
+        }
+    }
+
+
+    // Writes the settings of a result as the first comma-separated values of a line.
+    static void write_eval_settings(std::ofstream& rofs, const EvalResult& rresult)
+    {
+        rofs << rresult.loopstep << "," << rresult.params.kpreblur << "," << rresult.params.ksobel << ",";
+        rofs << rresult.params.angstep << "," << rresult.params.magthr;
+    }
+
+
+    bool save_eval_csv(const std::string& rsfile, const std::vector<EvalResult>& rvresults)
+    {
+        std::ofstream ofs(rsfile);
+        if (ofs.is_open())
+        {
+            ofs << "loopstep,preblur,sobel,angstep,magthr,detection_rate,loc_error,fp_per_frame,msec_per_frame,pareto" << std::endl;
+            for (const auto& rresult : rvresults)
+            {
+                write_eval_settings(ofs, rresult);
+                ofs << "," << rresult.detection_rate << "," << rresult.loc_error << "," << rresult.fp_per_frame;
+                ofs << "," << rresult.msec_per_frame << "," << ((rresult.is_pareto) ? 1 : 0) << std::endl;
+            }
+        }
+        return ofs.good();
+    }
+
+
+    bool save_roc_csv(const std::string& rsfile, const std::vector<EvalResult>& rvresults)
+    {
+        std::ofstream ofs(rsfile);
+        if (ofs.is_open())
+        {
+            ofs << "setting,loopstep,preblur,sobel,angstep,magthr,score,detection_rate,fp_per_frame" << std::endl;
+            for (size_t n = 0; n < rvresults.size(); ++n)
+            {
+                for (const auto& rpt : rvresults[n].roc)
+                {
+                    ofs << n << ",";
+                    write_eval_settings(ofs, rvresults[n]);
+                    ofs << "," << rpt.score << "," << rpt.detection_rate << "," << rpt.fp_per_frame << std::endl;
+                }
+            }
+        }
+        return ofs.good();
+    }
+}
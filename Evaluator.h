@@ -0,0 +1,152 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef EVALUATOR_H_
+#define EVALUATOR_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "GradientMatcher.h"
+#include "SceneGenerator.h"
+
+
+namespace ghalgo
+{
+    // Values of each setting to evaluate.  Every combination is evaluated.
+    class EvalGrid
+    {
+    public:
+        EvalGrid() :
+            loopsteps({ 1, 2, 4 }),
+            preblurs({ 1, 5, 9 }),
+            sobels({ 3, 5, 7 }),
+            angsteps({ 8.0, 16.0 }),
+            magthrs({ 0.1, 0.2, 0.3 }),
+            min_score(0.5),
+            roc_min_score(0.2),
+            max_dist_ratio(0.25) {}
+        virtual ~EvalGrid() {}
+    public:
+        std::vector<int> loopsteps;
+        std::vector<int> preblurs;
+        std::vector<int> sobels;
+        std::vector<double> angsteps;
+        std::vector<double> magthrs;
+        double min_score;           // score needed for a detection
+        double roc_min_score;       // lowest score of peaks kept for the ROC curve
+        double max_dist_ratio;      // a peak closer than this fraction of the smaller template side is a hit
+    };
+
+
+    // One point on an ROC curve.
+    class RocPoint
+    {
+    public:
+        RocPoint() : score(0.0), detection_rate(0.0), fp_per_frame(0.0) {}
+        virtual ~RocPoint() {}
+    public:
+        double score;               // score threshold
+        double detection_rate;      // fraction of template instances found with this threshold
+        double fp_per_frame;        // false positives per scene with this threshold
+    };
+
+
+    // Accuracy and speed of one combination of settings over a set of scenes.
+    class EvalResult
+    {
+    public:
+        EvalResult() :
+            loopstep(1),
+            detection_rate(0.0),
+            loc_error(0.0),
+            fp_per_frame(0.0),
+            msec_per_frame(0.0),
+            is_pareto(false) {}
+        virtual ~EvalResult() {}
+    public:
+        TemplateParams params;
+        int loopstep;
+        double detection_rate;      // fraction of template instances found
+        double loc_error;           // mean distance in pixels between found instances and their true centers
+        double fp_per_frame;        // peaks per scene that are not at a template instance
+        double msec_per_frame;      // time to match every template against one scene
+        bool is_pareto;             // true if no other result is at least as good at everything
+        std::vector<RocPoint> roc;  // detection rate and false positives as score threshold is lowered
+    };
+
+
+    // Measures how well each combination of matcher settings finds the templates in scenes with known poses.
+    // Every template is matched against every scene and the highest peaks are compared with the poses
+    // of the instances of that template.
+    class Evaluator
+    {
+    public:
+
+        Evaluator();
+        virtual ~Evaluator();
+
+        // Adds an 8-bit gray template image.  The name must be the one used in the scene poses.
+        // Returns false if image is not 8-bit gray.
+        bool add_template(const std::string& rsname, const cv::Mat& rimg);
+
+        // Adds an 8-bit gray scene and the poses of the template instances in it.
+        // Returns false if image is not 8-bit gray.
+        bool add_scene(const cv::Mat& rimg, const std::vector<ScenePose>& rvposes);
+
+        size_t get_template_count(void) const { return m_templates.size(); }
+        size_t get_scene_count(void) const { return m_scenes.size(); }
+
+        // Evaluates one combination of settings.
+        void evaluate(
+            const EvalGrid& rgrid,
+            const TemplateParams& rparams,
+            const int loopstep,
+            EvalResult& rresult) const;
+
+        // Evaluates every combination of settings in a grid then marks the Pareto front.
+        // The callback gets each result as soon as it is ready.
+        void evaluate_grid(
+            const EvalGrid& rgrid,
+            std::vector<EvalResult>& rvresults,
+            const std::function<void(const EvalResult&)>& rfunc = nullptr) const;
+
+    private:
+
+        std::vector<std::string> m_template_names;
+        std::vector<cv::Mat> m_templates;
+        std::vector<cv::Mat> m_scenes;
+        std::vector<std::vector<ScenePose>> m_scene_poses;
+    };
+
+
+    // Marks each result that is not beaten by another result on detection rate,
+    // false positives, and time without being worse on any of them.
+    void mark_pareto_front(std::vector<EvalResult>& rvresults);
+
+    // Saves a table of settings and results, or the ROC curve of each result, as comma-separated values.
+    // Returns false if file cannot be written.
+    bool save_eval_csv(const std::string& rsfile, const std::vector<EvalResult>& rvresults);
+    bool save_roc_csv(const std::string& rsfile, const std::vector<EvalResult>& rvresults);
+}
+
+#endif // EVALUATOR_H_
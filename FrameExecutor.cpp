@@ -0,0 +1,170 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include "FrameExecutor.h"
+
+
+namespace ghalgo
+{
+    FrameExecutor::FrameExecutor(const GradientMatcher& rmatcher, const int nthreads, const size_t depth) :
+        m_rmatcher(rmatcher),
+        m_depth(depth),
+        m_next_submit(0),
+        m_next_result(0),
+        m_is_stopping(false)
+    {
+        size_t ncores = (nthreads > 0) ? static_cast<size_t>(nthreads) : std::thread::hardware_concurrency();
+        ncores = std::max<size_t>(1, ncores);
+        m_depth = (m_depth > 0) ? m_depth : (2 * ncores);
+        for (size_t ii = 0; ii < ncores; ++ii)
+        {
+            m_threads.push_back(std::thread(&FrameExecutor::worker, this));
+        }
+    }
+
+
+    FrameExecutor::~FrameExecutor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_is_stopping = true;
+        }
+        m_cv_work.notify_all();
+        for (auto& rthread : m_threads)
+        {
+            rthread.join();
+        }
+    }
+
+
+    bool FrameExecutor::submit(const cv::Mat& rimg)
+    {
+        bool result = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if ((m_next_submit - m_next_result) < m_depth)
+            {
+                m_queue.push_back(std::make_pair(m_next_submit, rimg));
+                m_next_submit++;
+                result = true;
+            }
+        }
+        if (result)
+        {
+            m_cv_work.notify_one();
+        }
+        return result;
+    }
+
+
+    bool FrameExecutor::get_result(FrameResult& rresult)
+    {
+        bool result = false;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_next_result < m_next_submit)
+        {
+            // results may finish out of order so wait for the next one in sequence
+            m_cv_done.wait(lock, [this] { return m_done.count(m_next_result) != 0; });
+            auto iter = m_done.find(m_next_result);
+            rresult = iter->second;
+            m_done.erase(iter);
+            m_next_result++;
+            result = true;
+        }
+        return result;
+    }
+
+
+    size_t FrameExecutor::get_in_flight(void) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_next_submit - m_next_result;
+    }
+
+
+    void FrameExecutor::worker(void)
+    {
+        // each worker has its own scratch buffers
+        MatcherContext ctx;
+        ctx.engine.set_logging_enabled(false);
+
+        while (true)
+        {
+            std::pair<size_t, cv::Mat> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv_work.wait(lock, [this] { return m_is_stopping || !m_queue.empty(); });
+                if (m_queue.empty())
+                {
+                    // stopping and no more work
+                    break;
+                }
+                job = m_queue.front();
+                m_queue.pop_front();
+            }
+
+            FrameResult frame_result;
+            frame_result.index = job.first;
+
+            // take one snapshot of the template for the whole frame
+            // (the worker's context holds it and only reloads it when a new one is published)
+            const std::shared_ptr<const CompiledTemplate>& ptemplate = m_rmatcher.get_template(ctx);
+            if (ptemplate)
+            {
+                // the loop step and resolution mode are also read once so the score matches the votes
+                cv::Mat img_gray;
+                cv::Mat img_grad;
+                const int loopstep = m_rmatcher.get_loopstep();
+                const int res_mode = m_rmatcher.get_res_mode();
+                GradientMatcher::pre_process(ptemplate->params, job.second, img_gray);
+                if (res_mode == GradientMatcher::RES_FULL)
+                {
+                    GradientMatcher::apply_ghough(*ptemplate, ctx, img_gray, img_grad, frame_result.match, loopstep);
+                }
+                else
+                {
+                    GradientMatcher::apply_ghough_half(*ptemplate, ctx, img_gray, img_grad, frame_result.match,
+                        (res_mode == GradientMatcher::RES_HALF), loopstep);
+                }
+                minMaxLoc(frame_result.match, nullptr, &frame_result.qmax, nullptr, &frame_result.ptmax);
+
+                // a half resolution match image gives a location in the half size image
+                if (frame_result.match.size() != img_gray.size())
+                {
+                    frame_result.ptmax = cv::Point(frame_result.ptmax.x * 2, frame_result.ptmax.y * 2);
+                }
+                if (ptemplate->max_votes > 0.0)
+                {
+                    frame_result.score =
+                        (frame_result.qmax / ptemplate->max_votes) * GradientMatcher::get_score_scale(loopstep, res_mode);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done[frame_result.index] = frame_result;
+            }
+            m_cv_done.notify_all();
+        }
+    }
+}
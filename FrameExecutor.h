@@ -0,0 +1,105 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef FRAME_EXECUTOR_H_
+#define FRAME_EXECUTOR_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "GradientMatcher.h"
+
+
+namespace ghalgo
+{
+    // Result of matching one frame.
+    class FrameResult
+    {
+    public:
+        FrameResult() : index(0), qmax(0.0), ptmax(), score(0.0) {}
+        virtual ~FrameResult() {}
+    public:
+        // sequence number of frame (starts at 0)
+        size_t index;
+        // vote image (half size in the half resolution vote mode)
+        cv::Mat match;
+        // best match (location is in the full size frame)
+        double qmax;
+        cv::Point ptmax;
+        // best match normalized by template votes, loop step, and resolution mode (1.0 is perfect match)
+        double score;
+    };
+
+
+    // Matches frames on a pool of worker threads with several frames in flight.
+    // Each worker has its own context.  All workers share the matcher's current template,
+    // so a new template published on the matcher is picked up by the next frame.
+    // Frames are pre-processed (gray, equalization, blur) by the workers using the template settings.
+    // The matcher's loop step and resolution mode are read at the start of each frame.
+    // Results come out in the same order the frames went in.
+    class FrameExecutor
+    {
+    public:
+
+        // A thread count of 0 means use all cores.  A depth of 0 means two frames per thread.
+        FrameExecutor(const GradientMatcher& rmatcher, const int nthreads = 0, const size_t depth = 0);
+        virtual ~FrameExecutor();
+
+        // Queues a frame for matching.  The frame is not copied so the caller must not modify it
+        // until its result has been retrieved.  Returns false if the in-flight depth has been reached.
+        // In that case the next result must be retrieved before another frame can be submitted.
+        bool submit(const cv::Mat& rimg);
+
+        // Waits for the result of the oldest frame in flight.  Returns false if no frames are in flight.
+        bool get_result(FrameResult& rresult);
+
+        size_t get_in_flight(void) const;
+        size_t get_depth(void) const { return m_depth; }
+        bool is_full(void) const { return get_in_flight() >= m_depth; }
+
+    private:
+
+        void worker(void);
+
+        const GradientMatcher& m_rmatcher;
+        size_t m_depth;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv_work;
+        std::condition_variable m_cv_done;
+
+        // Frames waiting for a worker and finished frames waiting to be retrieved in order
+        std::deque<std::pair<size_t, cv::Mat>> m_queue;
+        std::map<size_t, FrameResult> m_done;
+
+        size_t m_next_submit;
+        size_t m_next_result;
+        bool m_is_stopping;
+
+        std::vector<std::thread> m_threads;
+    };
+}
+
+#endif // FRAME_EXECUTOR_H_
@@ -21,11 +21,210 @@
 // SOFTWARE.
 
 #include "opencv2/highgui.hpp"
+#include "opencv2/imgproc.hpp"
+#include <algorithm>
 #include "GradientMatcher.h"
 
 
 namespace ghalgo
 {
+    static ghalgo::LookupTable create_template_table(const TemplateParams& rparams, const cv::Mat& rkeyimg)
+    {
+        // key is 8-bit
+        // max key is angle steps + 1 because both 0 and 2pi can come from polar conversion
+        // the 0 and 2pi values are equivalent but it's one extra "key" that must be handled
+        // the template edge points are optionally thinned out to make voting faster
+        ghalgo::LookupTable table;
+        ghalgo::create_lookup_table_subsampled(rkeyimg, static_cast<uint8_t>(rparams.angstep + 1.0), table, rparams.subsample);
+        return table;
+    }
+
+
+    // Compiles a template that must fit in the memory budget of its settings.
+    // The size is estimated from the edge points before the table is built so an oversized template fails fast.
+    // In compact mode the subsample factor is raised to keep roughly as many points as will fit and it is
+    // raised a little more each time the result is still too big.  Returns null pointer if it does not fit.
+    static std::shared_ptr<const CompiledTemplate> compile_within_budget(const TemplateParams& rparams, const cv::Mat& rkeyimg)
+    {
+        const int MAX_TRIES = 8;
+        const double FACTOR_STEP = 1.25;
+
+        std::shared_ptr<const CompiledTemplate> result;
+        TemplateParams params = rparams;
+        const bool is_compact = (rparams.budget_policy == TemplateParams::BUDGET_COMPACT);
+
+        // the table has keys 0 to (angle steps + 1) (see above)
+        const size_t nkeys = static_cast<size_t>(rparams.angstep + 1.0) + 1;
+        const size_t nedges = static_cast<size_t>(countNonZero(rkeyimg));
+        const size_t fixed_bytes = get_mat_bytes(rkeyimg) + ghalgo::LookupTable::estimate_memory_usage(0, nkeys, rkeyimg.rows);
+        const size_t entry_bytes = ghalgo::LookupTable::estimate_memory_usage(nedges, 0, 0);
+
+        bool is_ok = (fixed_bytes < rparams.max_bytes);
+        if (is_ok)
+        {
+            // subsampling by a factor keeps about 1/factor of the edge points
+            const double fit_factor = static_cast<double>(entry_bytes) / static_cast<double>(rparams.max_bytes - fixed_bytes);
+            if (fit_factor > std::max(1.0, params.subsample))
+            {
+                is_ok = is_compact;
+                params.subsample = fit_factor;
+            }
+        }
+
+        for (int n = 0; is_ok && !result && (n < MAX_TRIES); ++n)
+        {
+            std::shared_ptr<const CompiledTemplate> ptemplate = std::make_shared<const CompiledTemplate>(params, rkeyimg);
+            if (ptemplate->memory_usage() <= rparams.max_bytes)
+            {
+                result = ptemplate;
+            }
+            else
+            {
+                is_ok = is_compact;
+                params.subsample = std::max(1.0, params.subsample) * FACTOR_STEP;
+            }
+        }
+
+        return result;
+    }
+
+
+    // Compiles a template from a key image and keeps it within the memory budget if the settings have one.
+    static std::shared_ptr<const CompiledTemplate> compile_key_image(const TemplateParams& rparams, const cv::Mat& rkeyimg)
+    {
+        return (rparams.max_bytes > 0) ?
+            compile_within_budget(rparams, rkeyimg) :
+            std::make_shared<const CompiledTemplate>(rparams, rkeyimg);
+    }
+
+
+    CompiledTemplate::CompiledTemplate(const TemplateParams& rparams, const cv::Mat& rkeyimg) :
+        params(rparams),
+        keyimg(rkeyimg),
+        table(create_template_table(rparams, rkeyimg)),
+        max_votes(static_cast<double>(table.max_votes))
+    {
+    }
+
+
+    CompiledTemplate::CompiledTemplate(const TemplateParams& rparams, const ghalgo::LookupTable& rtable, const cv::Mat& rkeyimg) :
+        params(rparams),
+        keyimg(rkeyimg),
+        table(rtable),
+        max_votes(static_cast<double>(table.max_votes))
+    {
+    }
+
+
+    double measure_peak_sharpness(const ghalgo::LookupTable& rtable, const cv::Mat& rkeyimg)
+    {
+        double qmax;
+        double qside;
+        cv::Point ptmax;
+        cv::Mat img_padded;
+        cv::Mat img_votes;
+
+        // pad the key image so the full response around the peak fits in the vote image
+        const int xpad = rkeyimg.cols / 2 + 1;
+        const int ypad = rkeyimg.rows / 2 + 1;
+        cv::copyMakeBorder(rkeyimg, img_padded, ypad, ypad, xpad, xpad, cv::BORDER_CONSTANT, cv::Scalar(0));
+        apply_ghough_transform_allpix<uint8_t, CV_32F, float>(img_padded, img_votes, rtable);
+        minMaxLoc(img_votes, nullptr, &qmax, nullptr, &ptmax);
+
+        // blank out the neighborhood of the peak and find highest remaining vote
+        // the neighborhood is a small fraction of the template size
+        const int radius = std::max(2, std::min(rkeyimg.cols, rkeyimg.rows) / 10);
+        cv::Mat mask = cv::Mat::ones(img_votes.size(), CV_8U);
+        cv::circle(mask, ptmax, radius, cv::Scalar(0), -1);
+        minMaxLoc(img_votes, nullptr, &qside, nullptr, nullptr, mask);
+
+        return (qside > 0.0) ? (qmax / qside) : qmax;
+    }
+
+
+    std::shared_ptr<const CompiledTemplate> prune_template(
+        const CompiledTemplate& rtemplate,
+        const double ratio,
+        double& rsharpness_retained)
+    {
+        ghalgo::LookupTable table;
+        ghalgo::prune_lookup_table(rtemplate.table, table, ratio);
+
+        rsharpness_retained = 0.0;
+        if (!rtemplate.keyimg.empty())
+        {
+            double qfull = measure_peak_sharpness(rtemplate.table, rtemplate.keyimg);
+            double qpruned = measure_peak_sharpness(table, rtemplate.keyimg);
+            rsharpness_retained = (qfull > 0.0) ? (qpruned / qfull) : 0.0;
+        }
+
+        return std::make_shared<const CompiledTemplate>(rtemplate.params, table, rtemplate.keyimg);
+    }
+
+
+    void add_background_key_counts(
+        const TemplateParams& rparams,
+        const cv::Mat& rimg,
+        std::vector<double>& rcounts)
+    {
+        MatcherContext ctx;
+        cv::Mat img_cgrad;
+        GradientMatcher::create_masked_gradient_orientation_img(rparams, ctx, rimg, img_cgrad);
+
+        // keys go from 1 to (angstep + 1) with 0 for pixels that are not edges
+        const size_t nkeys = static_cast<size_t>(std::max(ANG_STEP_MIN, std::min(ANG_STEP_MAX, rparams.angstep))) + 2;
+        if (rcounts.size() < nkeys)
+        {
+            rcounts.resize(nkeys, 0.0);
+        }
+        ghalgo::add_key_histogram<uint8_t>(img_cgrad, rcounts);
+    }
+
+
+    std::shared_ptr<const CompiledTemplate> weight_template_keys(
+        const CompiledTemplate& rtemplate,
+        const std::vector<double>& rbackground,
+        const double min_ratio,
+        int& rdropped)
+    {
+        const ghalgo::LookupTable& rtable = rtemplate.table;
+
+        // totals of edge keys in template and background (key 0 is not an edge)
+        double template_total = 0.0;
+        double background_total = 0.0;
+        for (size_t ii = 1; ii < rtable.elems.size(); ++ii)
+        {
+            template_total += rtable.elems[ii].size();
+            background_total += (ii < rbackground.size()) ? rbackground[ii] : 0.0;
+        }
+
+        std::vector<double> vkeep(rtable.elems.size(), 1.0);
+        rdropped = 0;
+        for (size_t ii = 1; ii < rtable.elems.size(); ++ii)
+        {
+            const double background_count = (ii < rbackground.size()) ? rbackground[ii] : 0.0;
+            if ((background_count > 0.0) && (template_total > 0.0) && rtable.elems[ii].size())
+            {
+                const double ratio =
+                    (rtable.elems[ii].size() / template_total) / (background_count / background_total);
+                if (ratio < min_ratio)
+                {
+                    vkeep[ii] = ratio / min_ratio;
+                    if ((vkeep[ii] * rtable.elems[ii].size()) < 0.5)
+                    {
+                        vkeep[ii] = 0.0;
+                        rdropped++;
+                    }
+                }
+            }
+        }
+
+        ghalgo::LookupTable table;
+        ghalgo::prune_lookup_table_keys(rtable, table, vkeep);
+        return std::make_shared<const CompiledTemplate>(rtemplate.params, table, rtemplate.keyimg);
+    }
+
+
     GradientMatcher::GradientMatcher()
     {
         init();
@@ -37,88 +236,521 @@ namespace ghalgo
     }
 
 
+    size_t MatcherContext::get_buffer_bytes(void) const
+    {
+        size_t result = get_mat_bytes(temp_dx) + get_mat_bytes(temp_dy) + get_mat_bytes(temp_mag);
+        result += get_mat_bytes(temp_ang) + get_mat_bytes(temp_mask);
+        result += get_mat_bytes(temp_luma) + get_mat_bytes(temp_pre) + get_mat_bytes(temp_half);
+        return result;
+    }
+
+
     void GradientMatcher::init(
         const int kblur,
         const int ksobel,
         const double magthr,
         const double angstep,
         const bool is_pre_CLAHE_enabled,
-        const int CLAHE_clip_limit)
+        const int CLAHE_clip_limit,
+        const double subsample)
     {
         // parameters for generating a template
-        m_kpreblur = kblur;
-        m_ksobel = ksobel;
-        m_magthr = magthr;
-        m_angstep = angstep;
-        m_is_pre_CLAHE_enabled = is_pre_CLAHE_enabled;
-        m_CLAHE_clip_limit = CLAHE_clip_limit;
-        
-        m_max_votes = 0.0;
-        m_loopstep = 1;
-        m_ghtable.clear();
+        m_params = TemplateParams(kblur, ksobel, magthr, angstep, is_pre_CLAHE_enabled, CLAHE_clip_limit, subsample);
+        m_loopstep.store(1);
+        m_res_mode.store(RES_FULL);
+        set_template(nullptr);
+    }
+
+
+    void GradientMatcher::set_template(std::shared_ptr<const CompiledTemplate> ptemplate)
+    {
+        // generation numbers are unique across matchers so a context can be used with more than one
+        // (0 is never used so it marks a context that has no template yet)
+        static std::atomic<uint64_t> next_generation(0);
+        std::atomic_store(&m_ptemplate, ptemplate);
+        m_template_generation.store(++next_generation);
+    }
+
+
+    const std::shared_ptr<const CompiledTemplate>& GradientMatcher::get_template(MatcherContext& rctx) const
+    {
+        // the template is stored before its generation number so a context that sees
+        // the new number always loads the new template (or an even newer one)
+        const uint64_t generation = m_template_generation.load();
+        if (generation != rctx.template_generation)
+        {
+            rctx.ptemplate = std::atomic_load(&m_ptemplate);
+            rctx.template_generation = generation;
+        }
+        return rctx.ptemplate;
+    }
+
+
+    bool GradientMatcher::wrap_frame(const FrameBuffer& rframe, cv::Mat& rimg)
+    {
+        bool result = false;
+        int img_type = CV_8UC1;
+        size_t min_stride = static_cast<size_t>(rframe.width);
+
+        switch (rframe.format)
+        {
+            case FrameBuffer::GRAY8:
+            case FrameBuffer::NV12:
+            case FrameBuffer::NV21:
+            case FrameBuffer::I420:
+            case FrameBuffer::YV12:
+            {
+                // the Y plane of a planar YUV frame comes first and has the full resolution
+                result = true;
+                break;
+            }
+            case FrameBuffer::YUYV:
+            case FrameBuffer::UYVY:
+            {
+                // Y alternates with U or V so the frame is viewed as 2-channel pixels
+                img_type = CV_8UC2;
+                min_stride *= 2;
+                result = true;
+                break;
+            }
+            case FrameBuffer::BGR24:
+            {
+                img_type = CV_8UC3;
+                min_stride *= 3;
+                result = true;
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+
+        result = result &&
+            (rframe.pdata != nullptr) &&
+            (rframe.width > 0) &&
+            (rframe.height > 0) &&
+            (rframe.stride >= min_stride);
+
+        if (result)
+        {
+            // OpenCV headers take non-const data but the header is only read
+            rimg = cv::Mat(rframe.height, rframe.width, img_type, const_cast<uint8_t *>(rframe.pdata), rframe.stride);
+        }
+
+        return result;
+    }
+
+
+    bool GradientMatcher::get_luma(const cv::Mat& ryuv, const int format, cv::Mat& rluma)
+    {
+        bool result = false;
+        switch (format)
+        {
+            case FrameBuffer::NV12:
+            case FrameBuffer::NV21:
+            case FrameBuffer::I420:
+            case FrameBuffer::YV12:
+            {
+                // chroma planes add half as many rows as the Y plane
+                result = (ryuv.type() == CV_8UC1) && ((ryuv.rows % 3) == 0);
+                if (result)
+                {
+                    rluma = ryuv.rowRange(0, (ryuv.rows * 2) / 3);
+                }
+                break;
+            }
+            case FrameBuffer::YUYV:
+            case FrameBuffer::UYVY:
+            {
+                result = (ryuv.type() == CV_8UC2);
+                if (result)
+                {
+                    cv::extractChannel(ryuv, rluma, FrameBuffer::get_packed_luma_channel(format));
+                }
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+        return result;
+    }
+
+
+    bool GradientMatcher::pre_process(
+        const TemplateParams& rparams,
+        MatcherContext& rctx,
+        const FrameBuffer& rframe,
+        cv::Mat& rout)
+    {
+        cv::Mat img_frame;
+        bool result = wrap_frame(rframe, img_frame);
+        if (result)
+        {
+            if (rframe.is_packed_yuv())
+            {
+                cv::extractChannel(img_frame, rctx.temp_luma, FrameBuffer::get_packed_luma_channel(rframe.format));
+                pre_process(rparams, rctx.temp_luma, rout);
+            }
+            else
+            {
+                pre_process(rparams, img_frame, rout);
+            }
+        }
+        return result;
+    }
+
+
+    void GradientMatcher::pre_process(const TemplateParams& rparams, const cv::Mat& rin, cv::Mat& rout)
+    {
+        // header for the result of the latest step
+        // a gray input is used directly by the first step that writes the output
+        cv::Mat img_gray = rin;
+
+        // get gray image
+        if (rin.channels() == 3)
+        {
+            cv::cvtColor(rin, rout, cv::COLOR_BGR2GRAY);
+            img_gray = rout;
+        }
+
+        // apply the optional histogram equalization setting
+        if (rparams.is_pre_CLAHE_enabled)
+        {
+            cv::Ptr<cv::CLAHE> pCLAHE = cv::createCLAHE();
+            pCLAHE->setClipLimit(static_cast<double>(rparams.CLAHE_clip_limit));
+            pCLAHE->apply(img_gray, rout);
+            img_gray = rout;
+        }
+
+        // apply the pre-blur setting
+        // or copy the input if there were no other steps
+        if (rparams.kpreblur > 1)
+        {
+            GaussianBlur(img_gray, rout, { rparams.kpreblur, rparams.kpreblur }, 0);
+        }
+        else if (rout.data != img_gray.data)
+        {
+            img_gray.copyTo(rout);
+        }
     }
 
 
     void GradientMatcher::create_masked_gradient_orientation_img(
+        const TemplateParams& rparams,
+        MatcherContext& rctx,
         const cv::Mat& rimg,
         cv::Mat& rmgo)
     {
         double qmax;
-        double angstep = m_angstep;
-        cv::Mat temp_dx;
-        cv::Mat temp_dy;
-        cv::Mat temp_mag;
-        cv::Mat temp_ang;
-        cv::Mat temp_mask;
+        GHALGO_PROFILE_BEGIN(rctx, "sobel");
+        calc_gradients(rparams, rctx, rimg);
+        GHALGO_PROFILE_END(rctx);
+        GHALGO_PROFILE_BEGIN(rctx, "encode");
+        minMaxLoc(rctx.temp_mag, nullptr, &qmax);
+        encode_gradients(rparams, rctx, qmax, rmgo);
+        GHALGO_PROFILE_END(rctx);
+    }
+
+
+    void GradientMatcher::create_masked_gradient_orientation_img(
+        const TemplateParams& rparams,
+        MatcherContext& rctx,
+        const cv::Mat& rimg,
+        cv::Mat& rmgo,
+        const double magmax)
+    {
+        GHALGO_PROFILE_BEGIN(rctx, "sobel");
+        calc_gradients(rparams, rctx, rimg);
+        GHALGO_PROFILE_END(rctx);
+        GHALGO_PROFILE_BEGIN(rctx, "encode");
+        encode_gradients(rparams, rctx, magmax, rmgo);
+        GHALGO_PROFILE_END(rctx);
+    }
+
+
+    void GradientMatcher::calc_gradients(const TemplateParams& rparams, MatcherContext& rctx, const cv::Mat& rimg)
+    {
         const int SOBEL_DEPTH = CV_32F;
 
         // calculate X and Y gradients for input image
-        cv::Sobel(rimg, temp_dx, SOBEL_DEPTH, 1, 0, m_ksobel);
-        cv::Sobel(rimg, temp_dy, SOBEL_DEPTH, 0, 1, m_ksobel);
+        cv::Sobel(rimg, rctx.temp_dx, SOBEL_DEPTH, 1, 0, rparams.ksobel);
+        cv::Sobel(rimg, rctx.temp_dy, SOBEL_DEPTH, 0, 1, rparams.ksobel);
 
         // convert X-Y gradients to magnitude and angle
-        cartToPolar(temp_dx, temp_dy, temp_mag, temp_ang);
+        cartToPolar(rctx.temp_dx, rctx.temp_dy, rctx.temp_mag, rctx.temp_ang);
+        rctx.grad_ksobel = rparams.ksobel;
+        rctx.grad_pdata = rimg.data;
+        rctx.grad_sz = rimg.size();
+    }
+
+
+    void GradientMatcher::encode_gradients(const TemplateParams& rparams, MatcherContext& rctx, const double magmax, cv::Mat& rmgo)
+    {
+        encode_gradients(rparams, rctx.temp_mag, rctx.temp_ang, magmax, rctx.temp_mask, rmgo);
+    }
+
+
+    void GradientMatcher::encode_gradients(
+        const TemplateParams& rparams,
+        const cv::Mat& rmag,
+        const cv::Mat& rang,
+        const double magmax,
+        cv::Mat& rmask,
+        cv::Mat& rmgo)
+    {
+        double angstep = rparams.angstep;
 
         // create mask for pixels that exceed gradient magnitude threshold
-        minMaxLoc(temp_mag, nullptr, &qmax);
-        temp_mask = (temp_mag > (qmax * m_magthr));
+        rmask = (rmag > (magmax * rparams.magthr));
 
         // scale, offset, and convert the angle image so 0-2pi becomes integers 1 to (ANG_STEP+1)
         // note that the angle can sometimes be 2pi which is equivalent to an angle of 0
         // for some binary source images not all gradient codes may be generated
         angstep = (angstep > ANG_STEP_MAX) ? ANG_STEP_MAX : angstep;
         angstep = (angstep < ANG_STEP_MIN) ? ANG_STEP_MIN: angstep;
-        temp_ang.convertTo(rmgo, CV_8U, angstep / (CV_2PI), 1.0);
+        rang.convertTo(rmgo, CV_8U, angstep / (CV_2PI), 1.0);
 
         // apply mask to eliminate pixels
-        rmgo &= temp_mask;
+        rmgo &= rmask;
     }
 
 
-    void GradientMatcher::init_ghough_table_from_img(const cv::Mat& rimg)
+    std::shared_ptr<const CompiledTemplate> GradientMatcher::compile_template(const cv::Mat& rimg) const
     {
+        MatcherContext ctx;
         cv::Mat img_cgrad;
 
         // create image of encoded Sobel gradient orientations from input image
         // then create Generalized Hough lookup table from that image
-        create_masked_gradient_orientation_img(rimg, img_cgrad);
+        create_masked_gradient_orientation_img(m_params, ctx, rimg, img_cgrad);
+        return compile_key_image(m_params, img_cgrad);
+    }
 
-        // key is 8-bit
-        // max key is angle steps + 1 because both 0 and 2pi can come from polar conversion
-        // the 0 and 2pi values are equivalent but it's one extra "key" that must be handled
-        ghalgo::create_lookup_table(img_cgrad, static_cast<uint8_t>(m_angstep + 1.0), m_ghtable);
 
-        // stash floating point value of ideal max votes
-        m_max_votes = static_cast<double>(m_ghtable.max_votes);
+    std::shared_ptr<const CompiledTemplate> GradientMatcher::compile_template_from_roi(
+        const TemplateParams& rparams,
+        MatcherContext& rctx,
+        const cv::Mat& rimg,
+        const cv::Rect& rroi)
+    {
+        std::shared_ptr<const CompiledTemplate> result;
+        const cv::Rect roi = rroi & cv::Rect(0, 0, rimg.cols, rimg.rows);
+        if (!roi.empty())
+        {
+            cv::Mat img_cgrad;
+            const bool is_reusable =
+                (rctx.grad_ksobel == rparams.ksobel) &&
+                (rctx.grad_pdata == rimg.data) &&
+                (rctx.grad_sz == rimg.size());
+            if (is_reusable)
+            {
+                // Sobel filters on an image view read the pixels around it
+                // so the gradients in the rectangle are the same as the ones for the whole image
+                double qmax;
+                cv::Mat mask;
+                const cv::Mat roi_mag = rctx.temp_mag(roi);
+                minMaxLoc(roi_mag, nullptr, &qmax);
+                encode_gradients(rparams, roi_mag, rctx.temp_ang(roi), qmax, mask, img_cgrad);
+            }
+            else
+            {
+                create_masked_gradient_orientation_img(rparams, rctx, rimg(roi), img_cgrad);
+            }
+            result = compile_key_image(rparams, img_cgrad);
+        }
+        return result;
+    }
+
+
+    std::shared_ptr<const CompiledTemplate> GradientMatcher::compile_template_file(
+        cv::Mat& template_image,
+        const std::string& rsfile,
+        const double prescale) const
+    {
+        std::shared_ptr<const CompiledTemplate> result;
+
+        template_image = cv::imread(rsfile, cv::IMREAD_GRAYSCALE);
+        if (!template_image.empty())
+        {
+            // scale the template image prior to generating table
+            // use recommended interpolation method when shrinking or enlarging
+            cv::Mat scaled_template_image;
+            resize(template_image, scaled_template_image, cv::Size(), prescale, prescale, (prescale > 1.0) ? cv::INTER_CUBIC : cv::INTER_AREA);
+
+            // GH pipeline should do the following:
+            // get gray image -> perform optional histogram equalization -> perform pre-blur -> do GH
+            pre_process(m_params, scaled_template_image, scaled_template_image);
+
+            // now that image has been pre-processed according to steps above
+            // use it to generate the lookup table
+            result = compile_template(scaled_template_image);
+        }
+
+        return result;
+    }
+
+
+    void GradientMatcher::init_ghough_table_from_img(const cv::Mat& rimg)
+    {
+        set_template(compile_template(rimg));
+    }
+
+
+    void GradientMatcher::init_ghough_table_from_roi(const cv::Mat& rimg, const cv::Rect& rroi)
+    {
+        set_template(compile_template_from_roi(m_params, m_context, rimg, rroi));
     }
 
 
     void GradientMatcher::apply_ghough(const cv::Mat& rin, cv::Mat& rgrad, cv::Mat& rmatch)
+    {
+        apply_ghough(m_context, rin, rgrad, rmatch);
+    }
+
+
+    void GradientMatcher::apply_ghough(MatcherContext& rctx, const cv::Mat& rin, cv::Mat& rgrad, cv::Mat& rmatch) const
+    {
+        // the context holds a reference to the template for the duration of this call
+        // a new template may be published by another thread at any time
+        const std::shared_ptr<const CompiledTemplate>& ptemplate = get_template(rctx);
+        if (ptemplate)
+        {
+            const int res_mode = get_res_mode();
+            if (res_mode == RES_FULL)
+            {
+                apply_ghough(*ptemplate, rctx, rin, rgrad, rmatch, get_loopstep());
+            }
+            else
+            {
+                apply_ghough_half(*ptemplate, rctx, rin, rgrad, rmatch, (res_mode == RES_HALF), get_loopstep());
+            }
+        }
+        else
+        {
+            // nothing to match so result is blank
+            rgrad = cv::Mat::zeros(rin.size(), CV_8U);
+            rmatch = cv::Mat::zeros(rin.size(), CV_16U);
+        }
+    }
+
+
+    void GradientMatcher::apply_ghough(
+        const CompiledTemplate& rtemplate,
+        MatcherContext& rctx,
+        const cv::Mat& rin,
+        cv::Mat& rgrad,
+        cv::Mat& rmatch,
+        const int loopstep)
     {
         // create image of encoded Sobel gradient orientations from input image
-        // then apply Generalized Hough transform
-        create_masked_gradient_orientation_img(rin, rgrad);
-        apply_ghough_transform_allpix<uint8_t, CV_16U, uint16_t>(rgrad, rmatch, m_ghtable, m_loopstep);
+        // using same gradient settings as template then apply Generalized Hough transform
+        create_masked_gradient_orientation_img(rtemplate.params, rctx, rin, rgrad);
+        GHALGO_PROFILE_BEGIN(rctx, "vote");
+        rctx.engine.apply(rgrad, rmatch, rtemplate.table, loopstep);
+        GHALGO_PROFILE_END(rctx);
+    }
+
+
+    void GradientMatcher::apply_ghough_half(
+        const CompiledTemplate& rtemplate,
+        MatcherContext& rctx,
+        const cv::Mat& rin,
+        cv::Mat& rgrad,
+        cv::Mat& rmatch,
+        const bool is_half_votes,
+        const int loopstep)
+    {
+        // the pre-blur has already removed most of the detail that would be lost by shrinking
+        // and area interpolation with a factor of exactly 2 just averages each 2x2 block
+        GHALGO_PROFILE_BEGIN(rctx, "shrink");
+        resize(rin, rctx.temp_half, cv::Size(rin.cols / 2, rin.rows / 2), 0.0, 0.0, cv::INTER_AREA);
+        GHALGO_PROFILE_END(rctx);
+        create_masked_gradient_orientation_img(rtemplate.params, rctx, rctx.temp_half, rgrad);
+        GHALGO_PROFILE_BEGIN(rctx, "vote");
+        apply_ghough_transform_half<uint8_t, CV_16U, uint16_t>(rgrad, rmatch, rtemplate.table, rin.size(), is_half_votes, loopstep);
+        GHALGO_PROFILE_END(rctx);
+    }
+
+
+    bool GradientMatcher::apply_ghough(
+        const CompiledTemplate& rtemplate,
+        MatcherContext& rctx,
+        const FrameBuffer& rframe,
+        cv::Mat& rgrad,
+        cv::Mat& rmatch,
+        const int loopstep)
+    {
+        GHALGO_PROFILE_BEGIN(rctx, "pre");
+        bool result = pre_process(rtemplate.params, rctx, rframe, rctx.temp_pre);
+        GHALGO_PROFILE_END(rctx);
+        if (result)
+        {
+            apply_ghough(rtemplate, rctx, rctx.temp_pre, rgrad, rmatch, loopstep);
+        }
+        return result;
+    }
+
+
+    void GradientMatcher::apply_ghough_strips(
+        const CompiledTemplate& rtemplate,
+        MatcherContext& rctx,
+        const cv::Mat& rin,
+        const int strip_rows,
+        const std::function<void(const StripResult&)>& rfunc,
+        const int loopstep)
+    {
+        const TemplateParams& rparams = rtemplate.params;
+        const int nstrip = std::max(1, strip_rows);
+
+        // each strip is extended by enough rows for the Sobel kernel to see the same neighbors
+        // as it would in the whole image and only the rows in the strip itself are used
+        // (a kernel size of -1 is the 3x3 Scharr filter)
+        const int overlap = std::max(1, rparams.ksobel / 2);
+
+        // first pass finds maximum gradient magnitude
+        double magmax = 0.0;
+        for (int r0 = 0; r0 < rin.rows; r0 += nstrip)
+        {
+            double qmax;
+            const int r1 = std::min(r0 + nstrip, rin.rows);
+            const int a0 = std::max(0, r0 - overlap);
+            const int a1 = std::min(rin.rows, r1 + overlap);
+            calc_gradients(rparams, rctx, rin.rowRange(a0, a1));
+            minMaxLoc(rctx.temp_mag.rowRange(r0 - a0, r1 - a0), nullptr, &qmax);
+            magmax = std::max(magmax, qmax);
+        }
+
+        // second pass encodes strips with global threshold and votes into rolling window
+        // rows are passed to callback as soon as no later strip can vote in them
+        cv::Mat img_key;
+        RollingVoteWindow<CV_16U, uint16_t> window;
+        window.init(rin.size(), rtemplate.table, nstrip);
+        for (int r0 = 0; r0 < rin.rows; r0 += nstrip)
+        {
+            const int r1 = std::min(r0 + nstrip, rin.rows);
+            const int a0 = std::max(0, r0 - overlap);
+            const int a1 = std::min(rin.rows, r1 + overlap);
+            create_masked_gradient_orientation_img(rparams, rctx, rin.rowRange(a0, a1), img_key, magmax);
+            for (int i = r0; i < r1; ++i)
+            {
+                window.add_row<uint8_t>(img_key.ptr<uint8_t>(i - a0), i, loopstep);
+            }
+
+            const int nfinal = window.get_final_count(r1);
+            if (nfinal > 0)
+            {
+                StripResult result;
+                result.row = window.get_first_row();
+                result.votes = window.get_rows(nfinal);
+                minMaxLoc(result.votes, nullptr, &result.qmax, nullptr, &result.ptmax);
+                result.ptmax.y += result.row;
+                rfunc(result);
+                window.release_rows(nfinal);
+            }
+        }
     }
 
 
@@ -127,32 +759,50 @@ namespace ghalgo
         const std::string& rsfile,
         const double prescale)
     {
-        template_image = cv::imread(rsfile, cv::IMREAD_GRAYSCALE);
+        set_template(compile_template_file(template_image, rsfile, prescale));
+    }
 
-        // scale the template image prior to generating table
-        // use recommended interpolation method when shrinking or enlarging
-        cv::Mat scaled_template_image;
-        resize(template_image, scaled_template_image, cv::Size(), prescale, prescale, (prescale > 1.0) ? cv::INTER_CUBIC : cv::INTER_AREA);
 
-        // GH pipeline should do the following:
-        // get gray image -> perform optional histogram equalization -> perform pre-blur -> do GH
+    double GradientMatcher::get_max_votes(void) const
+    {
+        std::shared_ptr<const CompiledTemplate> ptemplate = get_template();
+        return (ptemplate) ? ptemplate->max_votes : 0.0;
+    }
 
-        // apply the optional histogram equalization setting
-        if (m_is_pre_CLAHE_enabled)
-        {
-            cv::Ptr<cv::CLAHE> pCLAHE = cv::createCLAHE();
-            pCLAHE->setClipLimit(static_cast<double>(m_CLAHE_clip_limit));
-            pCLAHE->apply(scaled_template_image, scaled_template_image);
-        }
 
-        // apply the pre-blur setting
-        if (m_kpreblur > 1)
+    double GradientMatcher::get_score_scale(void) const
+    {
+        return get_score_scale(get_loopstep(), get_res_mode());
+    }
+
+
+    double GradientMatcher::get_score_scale(const int loopstep, const int res_mode)
+    {
+        // half resolution keys cover 2x2 blocks of the image so they are like a loop step of 2
+        // but a half resolution vote pixel also collects the votes for a 2x2 block so it makes up for that
+        const double res_scale = (res_mode == RES_HALF_KEYS) ? 4.0 : 1.0;
+        return static_cast<double>(loopstep * loopstep) * res_scale;
+    }
+
+
+    cv::Size GradientMatcher::get_template_size(void) const
+    {
+        std::shared_ptr<const CompiledTemplate> ptemplate = get_template();
+        return (ptemplate) ? ptemplate->table.img_sz : cv::Size(0, 0);
+    }
+
+
+    MemoryUsage GradientMatcher::get_memory_usage(void) const
+    {
+        MemoryUsage result;
+        std::shared_ptr<const CompiledTemplate> ptemplate = get_template();
+        if (ptemplate)
         {
-            GaussianBlur(scaled_template_image, scaled_template_image, { m_kpreblur, m_kpreblur }, 0);
+            result.table = ptemplate->table.memory_usage();
+            result.keyimg = get_mat_bytes(ptemplate->keyimg);
         }
-
-        // now that image has been pre-processed according to steps above
-        // use it to generate the lookup table
-        init_ghough_table_from_img(scaled_template_image);
+        result.buffers = m_context.get_buffer_bytes();
+        result.engine = m_context.engine.memory_usage();
+        return result;
     }
 }
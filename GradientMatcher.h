@@ -23,7 +23,13 @@
 #ifndef GRADIENT_MATCHER_H_
 #define GRADIENT_MATCHER_H_
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
 #include "ghbase.h"
+#include "PerfCounters.h"
+#include "VoteEngine.h"
 
 
 namespace ghalgo
@@ -31,34 +37,396 @@ namespace ghalgo
     constexpr double ANG_STEP_MAX = 254.0;
     constexpr double ANG_STEP_MIN = 4.0;
 
+    // Settings for generating a template.
+    // The gradient settings are also applied to every image that is matched against the template
+    // so the encoded orientation keys in the image are consistent with the keys in the table.
+    class TemplateParams
+    {
+    public:
+        TemplateParams(
+            const int kblur = 7,
+            const int ksobel = 7,
+            const double magthr = 0.2,
+            const double angstep = 8.0,
+            const bool is_pre_CLAHE_enabled = false,
+            const int CLAHE_clip_limit = 4,
+            const double subsample = 1.0) :
+            kpreblur(kblur),
+            ksobel(ksobel),
+            magthr(magthr),
+            angstep(angstep),
+            is_pre_CLAHE_enabled(is_pre_CLAHE_enabled),
+            CLAHE_clip_limit(CLAHE_clip_limit),
+            subsample(subsample),
+            max_bytes(0),
+            budget_policy(BUDGET_FAIL) {}
+        virtual ~TemplateParams() {}
+
+        // What to do when a compiled template would be bigger than the memory budget
+        enum
+        {
+            BUDGET_FAIL = 0,    // do not compile the template
+            BUDGET_COMPACT,     // subsample the template edge points until it fits
+        };
+    public:
+        int kpreblur;
+        int ksobel;
+        double magthr;
+        double angstep;
+        bool is_pre_CLAHE_enabled;
+        int CLAHE_clip_limit;
+        // factor for reducing number of template edge points (1 keeps all of them)
+        double subsample;
+        // memory budget in bytes for a compiled template (0 for no limit) and what to do if it is exceeded
+        size_t max_bytes;
+        int budget_policy;
+    };
+
+
+    // A compiled template is the Generalized Hough table plus the settings used to build it.
+    // It is never modified after construction so any number of threads can match against it.
+    class CompiledTemplate
+    {
+    public:
+        CompiledTemplate(const TemplateParams& rparams, const cv::Mat& rkeyimg);
+        CompiledTemplate(const TemplateParams& rparams, const ghalgo::LookupTable& rtable, const cv::Mat& rkeyimg = cv::Mat());
+        virtual ~CompiledTemplate() {}
+
+        // Returns approximate number of bytes used by the table and key image.
+        size_t memory_usage(void) const { return table.memory_usage() + get_mat_bytes(keyimg); }
+    public:
+        // settings that were used (the subsample factor may have been raised to fit the memory budget)
+        const TemplateParams params;
+        // encoded gradient image used to build the table (empty if template was loaded from a file)
+        const cv::Mat keyimg;
+        const ghalgo::LookupTable table;
+        const double max_votes;
+    };
+
+
+    // Matches a template's key image against the template's table and returns a measure of how distinct
+    // the peak is.  This is the ratio of the peak to the highest vote outside a small neighborhood of the peak.
+    double measure_peak_sharpness(const ghalgo::LookupTable& rtable, const cv::Mat& rkeyimg);
+
+    // Creates a pruned copy of a template that keeps roughly the given ratio (0 to 1) of the table entries.
+    // The peak sharpness of the pruned template relative to the original is passed back (1.0 means no loss).
+    // The sharpness is 0 if the template has no key image.
+    std::shared_ptr<const CompiledTemplate> prune_template(
+        const CompiledTemplate& rtemplate,
+        const double ratio,
+        double& rsharpness_retained);
+
+    // Adds the number of edge pixels with each orientation key in an image to a histogram of background key counts.
+    // The image should be pre-processed the same way as the images being matched.
+    // The key encoding comes from the template settings.  The histogram is resized if necessary.
+    void add_background_key_counts(
+        const TemplateParams& rparams,
+        const cv::Mat& rimg,
+        std::vector<double>& rcounts);
+
+    // Creates a copy of a template where keys that are common in the background but rare in the template
+    // have fewer table entries.  For each key the template-to-background ratio is the key's share of the
+    // table entries divided by its share of the background edge pixels.  Keys with a ratio below the minimum
+    // keep (ratio / minimum) of their entries.  Keys that would keep less than one entry are dropped.
+    // Keys that never appear in the background are kept.  The number of dropped keys is passed back.
+    std::shared_ptr<const CompiledTemplate> weight_template_keys(
+        const CompiledTemplate& rtemplate,
+        const std::vector<double>& rbackground,
+        const double min_ratio,
+        int& rdropped);
+
+
+    // Scratch buffers for the gradient calculations.
+    // Each thread that matches images needs its own context.
+    // Buffers are re-used from frame to frame so they are only allocated when the image size changes.
+    class MatcherContext
+    {
+    public:
+        MatcherContext() : grad_ksobel(0), grad_pdata(nullptr), template_generation(0) {}
+        virtual ~MatcherContext() {}
+
+        // Returns approximate number of bytes in the image buffers (not including the voting engine).
+        size_t get_buffer_bytes(void) const;
+    public:
+        cv::Mat temp_dx;
+        cv::Mat temp_dy;
+        cv::Mat temp_mag;
+        cv::Mat temp_ang;
+        cv::Mat temp_mask;
+
+        // Sobel kernel size and source image used for the gradient buffers (0 and null until they are calculated)
+        int grad_ksobel;
+        const uint8_t * grad_pdata;
+        cv::Size grad_sz;
+
+        // luma extracted from packed YUV frames and pre-processed image for frames from caller-owned buffers
+        cv::Mat temp_luma;
+        cv::Mat temp_pre;
+
+        // input shrunk to half size for half resolution modes
+        cv::Mat temp_half;
+
+        // Template last used by a matcher with this context and its generation number (0 until first use)
+        std::shared_ptr<const CompiledTemplate> ptemplate;
+        uint64_t template_generation;
+
+        // Voting engine with its own scratch space and tuning results
+        VoteEngine engine;
+
+        // Hardware counters for each stage of matching (only used when built with GHALGO_PROFILE)
+        FrameProfiler profiler;
+    };
+
+
+    // Describes a frame in a buffer owned by the caller such as a slot in a shared-memory ring buffer.
+    // The matcher reads the pixels in place so the buffer must not change until the call returns.
+    // For every YUV format the Y (luma) channel is used as the gray image and the chroma is ignored.
+    class FrameBuffer
+    {
+    public:
+        enum
+        {
+            GRAY8 = 0,  // 8-bit gray
+            BGR24,      // 8-bit BGR interleaved
+            NV12,       // 4:2:0 full resolution Y plane followed by interleaved UV plane
+            NV21,       // 4:2:0 full resolution Y plane followed by interleaved VU plane
+            I420,       // 4:2:0 full resolution Y plane followed by U and V planes
+            YV12,       // 4:2:0 full resolution Y plane followed by V and U planes
+            YUYV,       // 4:2:2 packed Y0 U Y1 V (luma must be extracted)
+            UYVY,       // 4:2:2 packed U Y0 V Y1 (luma must be extracted)
+        };
+
+        FrameBuffer(
+            const uint8_t * pdata = nullptr,
+            const int width = 0,
+            const int height = 0,
+            const size_t stride = 0,
+            const int format = GRAY8) :
+            pdata(pdata),
+            width(width),
+            height(height),
+            stride(stride),
+            format(format) {}
+        virtual ~FrameBuffer() {}
+
+        // Returns true if the Y channel is interleaved with chroma so it cannot be used in place.
+        bool is_packed_yuv(void) const { return (format == YUYV) || (format == UYVY); }
+
+        // Returns channel of a 2-channel view of a packed YUV format that holds the Y values.
+        static int get_packed_luma_channel(const int format) { return (format == UYVY) ? 1 : 0; }
+    public:
+        const uint8_t * pdata;
+        int width;
+        int height;
+        size_t stride;      // bytes from start of one row to start of next (of Y plane for planar YUV formats)
+        int format;
+    };
+
+
+    // Breakdown of the memory used by a matcher in bytes.
+    class MemoryUsage
+    {
+    public:
+        MemoryUsage() : table(0), keyimg(0), buffers(0), engine(0) {}
+        virtual ~MemoryUsage() {}
+        size_t total(void) const { return table + keyimg + buffers + engine; }
+    public:
+        size_t table;       // lookup table of current template
+        size_t keyimg;      // key image of current template
+        size_t buffers;     // context image buffers (these grow with the frame size)
+        size_t engine;      // voting engine scratch space
+    };
+
+
+    // Vote image rows that have become final while matching an image strip by strip.
+    // The votes are a view of a rolling window so they are only valid during the callback.
+    class StripResult
+    {
+    public:
+        StripResult() : row(0), qmax(0.0), ptmax(0, 0) {}
+        virtual ~StripResult() {}
+    public:
+        int row;            // image row of first row of votes
+        cv::Mat votes;
+        double qmax;        // highest vote in the rows
+        cv::Point ptmax;    // location of highest vote in image coordinates
+    };
+
+
     class GradientMatcher
     {
     public:
 
+        // Resolution modes for matching
+        enum
+        {
+            RES_FULL = 0,   // keys and votes at full resolution
+            RES_HALF_KEYS,  // keys from half resolution image and votes at full resolution
+            RES_HALF,       // keys and votes at half resolution
+        };
+
         GradientMatcher();
         virtual ~GradientMatcher();
 
+        // Applies settings for generating the next template and discards the current template.
         void init(
             const int kblur = 7,
             const int ksobel = 7,
             const double magthr = 0.2,
             const double angstep = 8.0,
             const bool is_pre_CLAHE_enabled = false,
-            const int CLAHE_clip_limit = 4);
+            const int CLAHE_clip_limit = 4,
+            const double subsample = 1.0);
+
+        // Converts an image to grayscale if necessary then applies the optional histogram equalization
+        // and the pre-blur settings.  The same steps are applied to templates and to images being matched.
+        // A gray input is only copied if no other step writes the output.
+        static void pre_process(const TemplateParams& rparams, const cv::Mat& rin, cv::Mat& rout);
+
+        // Creates an image header for a caller-owned frame without copying the pixels.
+        // The header is gray for gray and planar YUV formats (the Y plane is the gray image), BGR for color,
+        // and 2-channel for packed YUV formats.  It must only be read.
+        // Returns false if the frame description is not valid.
+        static bool wrap_frame(const FrameBuffer& rframe, cv::Mat& rimg);
+
+        // Gets the gray (luma) image from a whole YUV frame stored in a Mat, like the output of a capture
+        // that does not convert to RGB.  Planar 4:2:0 frames are 8-bit with 3/2 as many rows as the image.
+        // The result is a view of their Y plane.  Packed 4:2:2 frames are 2-channel and their Y channel is
+        // extracted to the result.  Returns false if the Mat does not have the layout of the format.
+        static bool get_luma(const cv::Mat& ryuv, const int format, cv::Mat& rluma);
+
+        // Same as the other pre-processing method but for a caller-owned frame.
+        // A gray or planar YUV frame goes straight to the first pre-processing step with no color conversion.
+        // A packed YUV frame only has its Y channel extracted (into a context buffer).
+        // Returns false if the frame description is not valid.
+        static bool pre_process(
+            const TemplateParams& rparams,
+            MatcherContext& rctx,
+            const FrameBuffer& rframe,
+            cv::Mat& rout);
 
         // This is the preprocessing step for the "classic" Generalized Hough algorithm.
         // Calculates Sobel derivatives of input grayscale image.  Converts to polar coordinates and
         // finds magnitude and angle (orientation).  Converts angle to integer with 4 to 254 steps.
         // Masks the pixels with gradient magnitudes above a threshold.
-        void create_masked_gradient_orientation_img(const cv::Mat& rimg, cv::Mat& rmgo);
+        // The context provides the scratch buffers.
+        static void create_masked_gradient_orientation_img(
+            const TemplateParams& rparams,
+            MatcherContext& rctx,
+            const cv::Mat& rimg,
+            cv::Mat& rmgo);
+
+        // Same as above but the magnitude threshold is relative to a given maximum magnitude
+        // instead of the maximum in the image.  This is for images that are processed in pieces.
+        static void create_masked_gradient_orientation_img(
+            const TemplateParams& rparams,
+            MatcherContext& rctx,
+            const cv::Mat& rimg,
+            cv::Mat& rmgo,
+            const double magmax);
+
+        // The two steps of the above for callers that take the maximum magnitude from only part of the image.
+        // Calculates Sobel derivatives and converts them to magnitude and angle in the context buffers.
+        static void calc_gradients(const TemplateParams& rparams, MatcherContext& rctx, const cv::Mat& rimg);
+
+        // Converts angles from context buffers to keys and masks pixels below the magnitude threshold.
+        static void encode_gradients(const TemplateParams& rparams, MatcherContext& rctx, const double magmax, cv::Mat& rmgo);
+
+        // Creates a compiled template from a grayscale image using the current settings.
+        // If the settings have a memory budget then the table size is estimated from the number of edge points
+        // before it is built.  If it will not fit then a null pointer is returned or the template edge points
+        // are subsampled until it fits, depending on the budget policy.
+        // This does not change the matcher so it can be called from any thread.
+        std::shared_ptr<const CompiledTemplate> compile_template(const cv::Mat& rimg) const;
+
+        // Creates a compiled template from a rectangle of a grayscale image whose gradients are in a context
+        // (for example right after it was matched with apply_ghough).  The Sobel gradients of the whole image
+        // are reused and only the magnitude threshold is applied again, relative to the maximum in the rectangle,
+        // so the result is the same as compiling the image in the rectangle.  If the context does not have
+        // gradients for the same image (same pixel data and size) made with the same Sobel kernel they are
+        // calculated again for the rectangle.  The pixels must not be changed after the gradients are calculated.
+        // Returns null pointer if the rectangle is empty or the template does not fit the memory budget.
+        static std::shared_ptr<const CompiledTemplate> compile_template_from_roi(
+            const TemplateParams& rparams,
+            MatcherContext& rctx,
+            const cv::Mat& rimg,
+            const cv::Rect& rroi);
+
+        // Loads an image from a file, scales it, blurs it, and compiles a template from it.
+        // It uses the settings that were applied by the "init" method.
+        // A reference to a blank image is passed in.  The loaded image is passed back.
+        // This does not change the matcher so it can be called from any thread.
+        // Returns null pointer if the file cannot be read or the template does not fit the memory budget.
+        std::shared_ptr<const CompiledTemplate> compile_template_file(
+            cv::Mat& template_image,
+            const std::string& rsfile,
+            const double prescale = 1.0) const;
 
         // Initializes Generalized Hough table from grayscale image.
         // Default parameters are good starting point for doing object identification.
         void init_ghough_table_from_img(const cv::Mat& rimg);
 
-        // Encodes gradients of input image and applies Generalized Hough transform
+        // Initializes Generalized Hough table from a rectangle of the image that was last matched
+        // with the matcher's own scratch buffers.  The gradients from matching are reused if possible.
+        void init_ghough_table_from_roi(const cv::Mat& rimg, const cv::Rect& rroi);
+
+        // Encodes gradients of input image and applies Generalized Hough transform.
+        // This version uses the matcher's own scratch buffers so it is for single-threaded use.
         void apply_ghough(const cv::Mat& rin, cv::Mat& rgrad, cv::Mat& rmatch);
 
+        // Encodes gradients of input image and applies Generalized Hough transform.
+        // The caller provides the scratch buffers so multiple threads can share one matcher.
+        void apply_ghough(MatcherContext& rctx, const cv::Mat& rin, cv::Mat& rgrad, cv::Mat& rmatch) const;
+
+        // Encodes gradients of input image and applies Generalized Hough transform for a specific template.
+        static void apply_ghough(
+            const CompiledTemplate& rtemplate,
+            MatcherContext& rctx,
+            const cv::Mat& rin,
+            cv::Mat& rgrad,
+            cv::Mat& rmatch,
+            const int loopstep = 1);
+
+        // Pre-processes a caller-owned frame and applies the Generalized Hough transform for a specific template.
+        // The frame is read in place so a gray or planar YUV frame is never converted or copied before the pre-blur.
+        // Returns false (and leaves results unchanged) if the frame description is not valid.
+        static bool apply_ghough(
+            const CompiledTemplate& rtemplate,
+            MatcherContext& rctx,
+            const FrameBuffer& rframe,
+            cv::Mat& rgrad,
+            cv::Mat& rmatch,
+            const int loopstep = 1);
+
+        // Encodes gradients of an image shrunk to half size and applies Generalized Hough transform.
+        // The template table is not changed.  Each key pixel votes as if it were at twice its position.
+        // The votes are full size or half size (same as the key image).  Since there are about 1/4 as many
+        // key pixels the full size votes are about 1/4 of the votes at full resolution (same as a loop step of 2).
+        // Each half size vote pixel collects the votes for 2x2 full size pixels so it gets about as many as
+        // a full resolution vote pixel.
+        static void apply_ghough_half(
+            const CompiledTemplate& rtemplate,
+            MatcherContext& rctx,
+            const cv::Mat& rin,
+            cv::Mat& rgrad,
+            cv::Mat& rmatch,
+            const bool is_half_votes,
+            const int loopstep = 1);
+
+        // Matches a template against a very large image one horizontal strip of rows at a time.
+        // Only the gradient buffers for one strip (plus a few rows of overlap for the Sobel kernel) and
+        // the vote rows that can still get votes are kept so memory use does not depend on the image height.
+        // A first pass finds the maximum gradient magnitude so the threshold is the same as for the whole image.
+        // Each time some vote rows become final they are passed to the callback with their highest vote.
+        // Results are the same as applying the transform to the whole image.
+        static void apply_ghough_strips(
+            const CompiledTemplate& rtemplate,
+            MatcherContext& rctx,
+            const cv::Mat& rin,
+            const int strip_rows,
+            const std::function<void(const StripResult&)>& rfunc,
+            const int loopstep = 1);
+
         // Loads an image from a file, scales it, blurs it, and creates Generalized Hough table from it.
         // It uses the settings that were applied by the "init" method.
         // A reference to a blank image is passed in.  The loaded image is passed back.
@@ -67,19 +435,79 @@ namespace ghalgo
             const std::string& rsfile,
             const double prescale = 1.0);
 
-    public:
+        // Publishes a new template with std::atomic_store and gives it a new generation number.
+        // This can be called from a control thread while other threads are matching.
+        // Calls already in progress finish with the old template and the next call picks up the new one.
+        // The shared pointer functions take a short internal lock in the common standard libraries
+        // so they are kept off the hot path (see the get_template that takes a context).
+        void set_template(std::shared_ptr<const CompiledTemplate> ptemplate);
+        std::shared_ptr<const CompiledTemplate> get_template(void) const { return std::atomic_load(&m_ptemplate); }
+
+        // Returns the current template for matching with a context.  The context keeps its own reference
+        // to the template and its generation number, so the only shared access is a lock-free load of the
+        // generation number unless a new template has been published since the context last used it.
+        // The old template is freed when every context that used it has picked up the new one.
+        const std::shared_ptr<const CompiledTemplate>& get_template(MatcherContext& rctx) const;
+
+        // Applies settings for generating the next template without disturbing the current template.
+        void set_params(const TemplateParams& rparams) { m_params = rparams; }
+        const TemplateParams& get_params(void) const { return m_params; }
+
+        // Voting engine for single-threaded apply method
+        VoteEngine& get_vote_engine(void) { return m_context.engine; }
+
+        int get_loopstep(void) const { return m_loopstep.load(); }
+        void set_loopstep(const int n) { m_loopstep.store(n); }
+
+        // Resolution mode for the apply methods that do not take a template
+        // In half resolution vote mode the match image is half size.
+        int get_res_mode(void) const { return m_res_mode.load(); }
+        void set_res_mode(const int n) { m_res_mode.store(n); }
+
+        // Returns factor that makes votes from the apply methods comparable to the ideal max votes.
+        // It accounts for the pixels skipped by the loop step and by the resolution mode.
+        // The static version is for callers that read the settings once for a whole frame.
+        double get_score_scale(void) const;
+        static double get_score_scale(const int loopstep, const int res_mode);
+
+        // Returns floating point value of ideal max votes for current template (0 if no template).
+        double get_max_votes(void) const;
+
+        // Returns size of image used to create current template (0x0 if no template).
+        cv::Size get_template_size(void) const;
+
+        // Returns memory used by current template and the scratch buffers for the single-threaded apply method.
+        MemoryUsage get_memory_usage(void) const;
+
+    private:
+
+        // Same as encode_gradients above for magnitude and angle images that may be parts of the context buffers.
+        static void encode_gradients(
+            const TemplateParams& rparams,
+            const cv::Mat& rmag,
+            const cv::Mat& rang,
+            const double magmax,
+            cv::Mat& rmask,
+            cv::Mat& rmgo);
+
+        // Settings for the next template (only used by the thread that compiles templates)
+        TemplateParams m_params;
+
+        // Step for skipping rows and columns in input image
+        std::atomic<int> m_loopstep;
+
+        // Resolution for computing keys and votes
+        std::atomic<int> m_res_mode;
 
-        int m_kpreblur;
-        int m_ksobel;
-        double m_magthr;
-        double m_angstep;
-        bool m_is_pre_CLAHE_enabled;
-        int m_CLAHE_clip_limit;
+        // Current template shared with any threads that are matching against it
+        // it must only be accessed with std::atomic_load and std::atomic_store (see set_template)
+        std::shared_ptr<const CompiledTemplate> m_ptemplate;
 
-        double m_max_votes;
+        // Generation number of current template (changed after the template is stored)
+        std::atomic<uint64_t> m_template_generation;
 
-        int m_loopstep;
-        ghalgo::LookupTable m_ghtable;
+        // Scratch buffers for single-threaded apply method
+        MatcherContext m_context;
     };
 }
 
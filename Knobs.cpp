@@ -38,10 +38,17 @@ Knobs::Knobs() :
     noutmode(Knobs::OUT_COLOR),
     op_id(Knobs::OP_NONE),
     nloopstep(1),
+    nresmode(0),
     nimgscale(3),
     nksobel(4),
+    nsubsample(0),
+    npruneratio(0),
+    nkeyratio(0),
     vimgscale({ 0.25, 0.325, 0.4, 0.5, 0.625, 0.75, 1.0 }),
-    vksobel({ -1, 1, 3, 5, 7})
+    vksobel({ -1, 1, 3, 5, 7}),
+    vsubsample({ 1.0, 2.0, 4.0, 8.0 }),
+    vpruneratio({ 1.0, 0.5, 0.25, 0.125 }),
+    vkeyratio({ 0.0, 0.5, 1.0, 2.0 })
 {
 }
 
@@ -67,10 +74,16 @@ void Knobs::show_help(void) const
     std::cout << "a         Toggle acquisition-from-camera mode" << std::endl;
     std::cout << "            - Click Left mouse button to select corners" << std::endl;
     std::cout << "            - Double-click left mouse button to apply new template" << std::endl;
+    std::cout << "b         Add current image to background sample for key weighting" << std::endl;
     std::cout << "d         Toggle template image display in upper right corner" << std::endl;
     std::cout << "e         Toggle histogram equalization" << std::endl;
     std::cout << "f         Toggle feedback mode" << std::endl;
+    std::cout << "h         Select next resolution mode (full, half-res keys, half-res keys and votes)" << std::endl;
+    std::cout << "k         Select next minimum template-to-background key ratio (off, 0.5, 1, 2)" << std::endl;
+    std::cout << "m         Show memory usage of matcher" << std::endl;
+    std::cout << "p         Select next template prune ratio (1, 1/2, 1/4, 1/8)" << std::endl;
     std::cout << "r         Toggle recording mode" << std::endl;
+    std::cout << "s         Select next template edge subsampling factor (1, 2, 4, 8)" << std::endl;
     std::cout << "t         Select next template from collection" << std::endl;
     std::cout << "u         Update Hough lookup table from current settings" << std::endl;
     std::cout << "v         Create video from files in movie folder" << std::endl;
@@ -157,11 +170,42 @@ void Knobs::handle_keypress(const char ckey)
             toggle_template_display_enabled();
             break;
         }
+        case 'h':
+        {
+            next_res_mode();
+            break;
+        }
         case 'e':
         {
             toggle_equ_hist_enabled();
             break;
         }
+        case 'b':
+        {
+            is_op_required = true;
+            op_id = Knobs::OP_BACKGROUND;
+            break;
+        }
+        case 'k':
+        {
+            next_key_ratio();
+            is_op_required = true;
+            op_id = Knobs::OP_UPDATE;
+            break;
+        }
+        case 'm':
+        {
+            is_op_required = true;
+            op_id = Knobs::OP_MEMORY;
+            break;
+        }
+        case 'p':
+        {
+            next_prune_ratio();
+            is_op_required = true;
+            op_id = Knobs::OP_UPDATE;
+            break;
+        }
         case 'r':
         {
             is_op_required = true;
@@ -169,6 +213,13 @@ void Knobs::handle_keypress(const char ckey)
             toggle_record_enabled();
             break;
         }
+        case 's':
+        {
+            next_subsample();
+            is_op_required = true;
+            op_id = Knobs::OP_UPDATE;
+            break;
+        }
         case 't':
         {
             is_op_required = true;
@@ -213,6 +264,7 @@ void Knobs::handle_keypress(const char ckey)
         std::cout << "  Out=" << sout[noutmode];
         std::cout << "  Scale=" << vimgscale[nimgscale];
         std::cout << "  Step=" << nloopstep;
+        std::cout << "  Res=" << nresmode;
         std::cout << "  Fb=" << is_feedback_mode_enabled;
         std::cout << std::endl;
     }
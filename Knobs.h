@@ -49,6 +49,8 @@ public:
         OP_UPDATE,
         OP_RECORD,
         OP_MAKE_VIDEO,
+        OP_BACKGROUND,
+        OP_MEMORY,
     };
 
     Knobs();
@@ -95,6 +97,19 @@ public:
     void inc_ksobel(void) { nksobel = (nksobel < (vksobel.size() - 1)) ? nksobel + 1 : nksobel; }
     void dec_ksobel(void) { nksobel = (nksobel > 0) ? nksobel - 1 : nksobel; };
 
+    double get_subsample(void) const { return vsubsample[nsubsample]; }
+    void next_subsample(void) { nsubsample = (nsubsample + 1) % vsubsample.size(); }
+
+    double get_prune_ratio(void) const { return vpruneratio[npruneratio]; }
+    void next_prune_ratio(void) { npruneratio = (npruneratio + 1) % vpruneratio.size(); }
+
+    double get_key_ratio(void) const { return vkeyratio[nkeyratio]; }
+    void next_key_ratio(void) { nkeyratio = (nkeyratio + 1) % vkeyratio.size(); }
+
+    // resolution mode is 0 (full), 1 (half resolution keys), or 2 (half resolution keys and votes)
+    int get_res_mode(void) const { return nresmode; }
+    void next_res_mode(void) { nresmode = (nresmode + 1) % 3; }
+
     int get_loopstep(void) const { return nloopstep; }
     void inc_loopstep(void) { nloopstep = (nloopstep < 4) ? nloopstep + 1 : nloopstep; }
     void dec_loopstep(void) { nloopstep = (nloopstep > 1) ? nloopstep - 1 : nloopstep; };
@@ -140,17 +155,38 @@ private:
     // Step for running one pass of algorithm
     int nloopstep;
 
+    // Resolution for computing keys and votes
+    int nresmode;
+
     // Index of currently selected scale factor
     size_t nimgscale;
 
     // Index of currently selected Sobel kernel size
     size_t nksobel;
 
+    // Index of currently selected template edge subsampling factor
+    size_t nsubsample;
+
+    // Index of currently selected template prune ratio
+    size_t npruneratio;
+
+    // Index of currently selected minimum template-to-background key ratio
+    size_t nkeyratio;
+
     // Array of supported scale factors
     std::vector<double> vimgscale;
 
     // Array of supported Sobel kernel sizes
     std::vector<int> vksobel;
+
+    // Array of supported template edge subsampling factors
+    std::vector<double> vsubsample;
+
+    // Array of supported template prune ratios (fraction of table entries to keep)
+    std::vector<double> vpruneratio;
+
+    // Array of supported minimum template-to-background key ratios (0 disables key weighting)
+    std::vector<double> vkeyratio;
 };
 
 #endif // KNOBS_H_
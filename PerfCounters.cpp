@@ -0,0 +1,247 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "opencv2/imgproc.hpp"
+#include <cstring>
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include "Windows.h"
+#endif
+
+
+namespace ghalgo
+{
+#ifdef __linux__
+    // Opens a counter for one event on the calling thread (user mode only).
+    // Returns file descriptor or -1 if the event cannot be counted.
+    static int open_perf_event(const uint32_t type, const uint64_t config)
+    {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+
+    // Returns config for a cache read miss event.
+    static uint64_t get_cache_read_miss_config(const uint64_t cache)
+    {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+#endif
+
+
+    const char * PerfCounts::get_name(const int n)
+    {
+        static const char * snames[COUNT] = { "cycles", "instructions", "L1D-misses", "LLC-misses", "branch-misses" };
+        return ((n >= 0) && (n < COUNT)) ? snames[n] : "unknown";
+    }
+
+
+    double PerfCounts::get_msec(void) const
+    {
+        return (1000.0 * ticks) / cv::getTickFrequency();
+    }
+
+
+    PerfCounts& PerfCounts::operator+=(const PerfCounts& rother)
+    {
+        for (int n = 0; n < COUNT; ++n)
+        {
+            values[n] += rother.values[n];
+        }
+        ticks += rother.ticks;
+        return *this;
+    }
+
+
+    PerfCounts& PerfCounts::operator-=(const PerfCounts& rother)
+    {
+        for (int n = 0; n < COUNT; ++n)
+        {
+            values[n] -= rother.values[n];
+        }
+        ticks -= rother.ticks;
+        return *this;
+    }
+
+
+    PerfCounters::PerfCounters()
+    {
+        for (int n = 0; n < PerfCounts::COUNT; ++n)
+        {
+            m_fds[n] = -1;
+        }
+    }
+
+
+    PerfCounters::~PerfCounters()
+    {
+        close();
+    }
+
+
+    bool PerfCounters::open(void)
+    {
+        bool result = false;
+        close();
+#ifdef __linux__
+        // each event is opened by itself so one that is not supported does not stop the others
+        m_fds[PerfCounts::CYCLES] = open_perf_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        m_fds[PerfCounts::INSTRUCTIONS] = open_perf_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        m_fds[PerfCounts::L1D_MISSES] = open_perf_event(PERF_TYPE_HW_CACHE, get_cache_read_miss_config(PERF_COUNT_HW_CACHE_L1D));
+        m_fds[PerfCounts::LLC_MISSES] = open_perf_event(PERF_TYPE_HW_CACHE, get_cache_read_miss_config(PERF_COUNT_HW_CACHE_LL));
+        m_fds[PerfCounts::BRANCH_MISSES] = open_perf_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#elif defined(_WIN32)
+        // only cycles are available and there is nothing to open
+        // so the descriptor just marks the event as available
+        m_fds[PerfCounts::CYCLES] = 0;
+#endif
+        for (int n = 0; n < PerfCounts::COUNT; ++n)
+        {
+            result = result || is_available(n);
+        }
+        return result;
+    }
+
+
+    void PerfCounters::close(void)
+    {
+        for (int n = 0; n < PerfCounts::COUNT; ++n)
+        {
+#ifdef __linux__
+            if (m_fds[n] >= 0)
+            {
+                ::close(m_fds[n]);
+            }
+#endif
+            m_fds[n] = -1;
+        }
+    }
+
+
+    bool PerfCounters::is_available(const int n) const
+    {
+        return (n >= 0) && (n < PerfCounts::COUNT) && (m_fds[n] >= 0);
+    }
+
+
+    void PerfCounters::read(PerfCounts& rcounts) const
+    {
+        for (int n = 0; n < PerfCounts::COUNT; ++n)
+        {
+            uint64_t value = 0;
+#ifdef __linux__
+            if ((m_fds[n] < 0) || (::read(m_fds[n], &value, sizeof(value)) != sizeof(value)))
+            {
+                value = 0;
+            }
+#elif defined(_WIN32)
+            ULONG64 cycles = 0;
+            if ((n == PerfCounts::CYCLES) && (m_fds[n] >= 0) && QueryThreadCycleTime(GetCurrentThread(), &cycles))
+            {
+                value = cycles;
+            }
+#endif
+            rcounts.values[n] = value;
+        }
+        rcounts.ticks = cv::getTickCount();
+    }
+
+
+    FrameProfiler::FrameProfiler() :
+        m_is_enabled(false),
+        m_pstage(nullptr)
+    {
+    }
+
+
+    FrameProfiler::~FrameProfiler()
+    {
+    }
+
+
+    bool FrameProfiler::enable(const bool is_enabled)
+    {
+        bool result = false;
+        m_counters.close();
+        if (is_enabled)
+        {
+            result = m_counters.open();
+        }
+        m_is_enabled = is_enabled;
+        return result;
+    }
+
+
+    void FrameProfiler::begin_frame(void)
+    {
+        m_stages.clear();
+        m_pstage = nullptr;
+    }
+
+
+    void FrameProfiler::begin_stage(const char * pname)
+    {
+        m_pstage = pname;
+        m_counters.read(m_stage_start);
+    }
+
+
+    void FrameProfiler::end_stage(void)
+    {
+        if (m_pstage)
+        {
+            PerfCounts counts;
+            m_counters.read(counts);
+            counts -= m_stage_start;
+
+            // add to stage with same name or make a new one
+            StageProfile * pstage = nullptr;
+            for (auto& rstage : m_stages)
+            {
+                if (std::strcmp(rstage.pname, m_pstage) == 0)
+                {
+                    pstage = &rstage;
+                }
+            }
+            if (!pstage)
+            {
+                m_stages.push_back(StageProfile());
+                pstage = &m_stages.back();
+                pstage->pname = m_pstage;
+            }
+            pstage->counts += counts;
+            pstage->calls++;
+            m_pstage = nullptr;
+        }
+    }
+}
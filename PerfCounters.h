@@ -0,0 +1,154 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <cstdint>
+#include <vector>
+
+
+namespace ghalgo
+{
+    // Hardware event counts and elapsed time for a span of code.
+    class PerfCounts
+    {
+    public:
+
+        // Hardware events
+        enum
+        {
+            CYCLES = 0,
+            INSTRUCTIONS,
+            L1D_MISSES,     // level 1 data cache read misses
+            LLC_MISSES,     // last level cache read misses
+            BRANCH_MISSES,
+            COUNT,
+        };
+
+        PerfCounts() : values(), ticks(0) {}
+        virtual ~PerfCounts() {}
+
+        // Returns name of a hardware event.
+        static const char * get_name(const int n);
+
+        double get_msec(void) const;
+
+        PerfCounts& operator+=(const PerfCounts& rother);
+        PerfCounts& operator-=(const PerfCounts& rother);
+
+    public:
+        uint64_t values[COUNT];
+        int64_t ticks;
+    };
+
+
+    // Hardware performance counters for the calling thread.
+    // They are read with perf_event_open on Linux.  On Windows only cycles are counted, with
+    // QueryThreadCycleTime (which also counts cycles spent in the kernel for the thread).
+    // On other systems, or if the kernel does not allow it (see /proc/sys/kernel/perf_event_paranoid)
+    // or the hardware does not have an event, that event reads as 0 and only the time is measured.
+    // Work done by other threads is not counted.
+    class PerfCounters
+    {
+    public:
+
+        PerfCounters();
+        virtual ~PerfCounters();
+
+        // Opens the counters.  Returns true if at least one hardware event can be counted.
+        bool open(void);
+        void close(void);
+
+        // Returns true if a hardware event is being counted.
+        bool is_available(const int n) const;
+
+        // Reads the totals since the counters were opened.
+        void read(PerfCounts& rcounts) const;
+
+    private:
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        int m_fds[PerfCounts::COUNT];
+    };
+
+
+    // Counts for one stage of matching a frame.
+    class StageProfile
+    {
+    public:
+        StageProfile() : pname(nullptr), calls(0) {}
+        virtual ~StageProfile() {}
+    public:
+        const char * pname;
+        int calls;
+        PerfCounts counts;
+    };
+
+
+    // Collects counts for each stage of matching a frame.
+    // The stage hooks in the matcher are only compiled when GHALGO_PROFILE is defined
+    // and they do nothing until the profiler is enabled.
+    class FrameProfiler
+    {
+    public:
+
+        FrameProfiler();
+        virtual ~FrameProfiler();
+
+        // Enables or disables the profiler.  Returns true if hardware events are being counted.
+        bool enable(const bool is_enabled);
+        bool is_enabled(void) const { return m_is_enabled; }
+
+        // Clears the stages for a new frame.
+        void begin_frame(void);
+
+        // Starts and ends a stage.  Stages with the same name are added together.
+        void begin_stage(const char * pname);
+        void end_stage(void);
+
+        const std::vector<StageProfile>& get_stages(void) const { return m_stages; }
+        const PerfCounters& get_counters(void) const { return m_counters; }
+
+    private:
+
+        PerfCounters m_counters;
+        bool m_is_enabled;
+        std::vector<StageProfile> m_stages;
+        PerfCounts m_stage_start;
+        const char * m_pstage;
+    };
+}
+
+
+// Stage hooks for matching a frame with a MatcherContext
+#ifdef GHALGO_PROFILE
+#define GHALGO_PROFILE_BEGIN(rctx, sname)   do { if ((rctx).profiler.is_enabled()) { (rctx).profiler.begin_stage(sname); } } while (0)
+#define GHALGO_PROFILE_END(rctx)            do { if ((rctx).profiler.is_enabled()) { (rctx).profiler.end_stage(); } } while (0)
+#else
+#define GHALGO_PROFILE_BEGIN(rctx, sname)
+#define GHALGO_PROFILE_END(rctx)
+#endif
+
+#endif // PERF_COUNTERS_H_
@@ -0,0 +1,256 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "opencv2/imgproc.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include "SceneGenerator.h"
+
+
+namespace ghalgo
+{
+    SceneGenerator::SceneGenerator()
+    {
+    }
+
+
+    SceneGenerator::~SceneGenerator()
+    {
+    }
+
+
+    bool SceneGenerator::add_template(const std::string& rsname, const cv::Mat& rimg)
+    {
+        bool result = false;
+        if ((rimg.type() == CV_8UC1) && !rimg.empty())
+        {
+            m_names.push_back(rsname);
+            m_templates.push_back(rimg.clone());
+            result = true;
+        }
+        return result;
+    }
+
+
+    bool SceneGenerator::generate(
+        const SceneSettings& rsettings,
+        const uint64_t seed,
+        cv::Mat& rscene,
+        std::vector<ScenePose>& rvposes) const
+    {
+        const int MAX_TRIES = 100;
+
+        bool result = false;
+        rvposes.clear();
+
+        if (!m_templates.empty())
+        {
+            // every random number comes from this in a fixed order
+            cv::RNG rng(seed);
+
+            const int bg = (rsettings.background >= 0) ? rsettings.background : m_templates[0].at<uint8_t>(0, 0);
+            rscene = cv::Mat(rsettings.size, CV_8U, cv::Scalar(bg));
+
+            // clutter shapes are drawn first so templates are on top of them
+            // each random number is drawn in its own statement since the order that
+            // function arguments are evaluated is up to the compiler
+            int rmax = INT_MAX;
+            for (const auto& rimg : m_templates)
+            {
+                rmax = std::min(rmax, std::min(rimg.cols, rimg.rows) / 2);
+            }
+            rmax = std::max(4, rmax);
+            const int nclutter = cvRound((rsettings.clutter_density * rsettings.size.area()) / 10000.0);
+            for (int n = 0; n < nclutter; ++n)
+            {
+                const int x = rng.uniform(0, rsettings.size.width);
+                const int y = rng.uniform(0, rsettings.size.height);
+                const cv::Point pt(x, y);
+                const int r = rng.uniform(3, rmax + 1);
+                const cv::Scalar level(rng.uniform(0, 256));
+                switch (n % 3)
+                {
+                    case 0:
+                    {
+                        cv::circle(rscene, pt, r, level, -1);
+                        break;
+                    }
+                    case 1:
+                    {
+                        cv::rectangle(rscene, cv::Rect(pt.x - r, pt.y - r / 2, 2 * r, r), level, -1);
+                        break;
+                    }
+                    default:
+                    {
+                        const int dx = rng.uniform(-r, r + 1);
+                        const int dy = rng.uniform(-r, r + 1);
+                        const int thickness = rng.uniform(1, 4);
+                        cv::line(rscene, pt, cv::Point(pt.x + dx, pt.y + dy), level, thickness);
+                        break;
+                    }
+                }
+            }
+
+            for (int n = 0; n < rsettings.ninstances; ++n)
+            {
+                ScenePose pose;
+                pose.index = rng.uniform(0, static_cast<int>(m_templates.size()));
+                pose.name = m_names[pose.index];
+                pose.scale = (rsettings.scale_max > rsettings.scale_min) ? rng.uniform(rsettings.scale_min, rsettings.scale_max) : rsettings.scale_min;
+                pose.angle = (rsettings.angle_max > 0.0) ? rng.uniform(-rsettings.angle_max, rsettings.angle_max) : 0.0;
+                const cv::Mat& rimg = m_templates[pose.index];
+
+                // size of bounding box of scaled and rotated template
+                const double theta = pose.angle * CV_PI / 180.0;
+                const double c = std::fabs(std::cos(theta));
+                const double s = std::fabs(std::sin(theta));
+                const cv::Size bbox_sz(
+                    static_cast<int>(std::ceil(pose.scale * (rimg.cols * c + rimg.rows * s))),
+                    static_cast<int>(std::ceil(pose.scale * (rimg.cols * s + rimg.rows * c))));
+
+                // find a spot that does not overlap another instance
+                bool is_placed = false;
+                const int xmax = rsettings.size.width - bbox_sz.width;
+                const int ymax = rsettings.size.height - bbox_sz.height;
+                for (int k = 0; (k < MAX_TRIES) && !is_placed && (xmax >= 0) && (ymax >= 0); ++k)
+                {
+                    const int x = rng.uniform(0, xmax + 1);
+                    const int y = rng.uniform(0, ymax + 1);
+                    pose.bbox = cv::Rect(cv::Point(x, y), bbox_sz);
+                    is_placed = true;
+                    for (const auto& rpose : rvposes)
+                    {
+                        if ((pose.bbox & rpose.bbox).area() > 0)
+                        {
+                            is_placed = false;
+                            break;
+                        }
+                    }
+                }
+
+                if (is_placed)
+                {
+                    // the template center is the same one used for its lookup table
+                    const cv::Point tcenter(rimg.cols / 2, rimg.rows / 2);
+                    pose.center = cv::Point(pose.bbox.x + bbox_sz.width / 2, pose.bbox.y + bbox_sz.height / 2);
+                    if ((pose.scale == 1.0) && (pose.angle == 0.0))
+                    {
+                        rimg.copyTo(rscene(cv::Rect(pose.center - tcenter, rimg.size())));
+                    }
+                    else
+                    {
+                        // scene pixels outside the warped template are left alone
+                        cv::Mat M = cv::getRotationMatrix2D(cv::Point2f(static_cast<float>(tcenter.x), static_cast<float>(tcenter.y)), pose.angle, pose.scale);
+                        M.at<double>(0, 2) += pose.center.x - tcenter.x;
+                        M.at<double>(1, 2) += pose.center.y - tcenter.y;
+                        cv::warpAffine(rimg, rscene, M, rscene.size(), cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+                    }
+
+                    if (rsettings.occlusion > 0.0)
+                    {
+                        // cover a random part of the instance
+                        const double side = std::sqrt(std::min(1.0, rsettings.occlusion));
+                        const cv::Size occ_sz(
+                            std::max(1, cvRound(side * bbox_sz.width)),
+                            std::max(1, cvRound(side * bbox_sz.height)));
+                        const int x = pose.bbox.x + rng.uniform(0, bbox_sz.width - occ_sz.width + 1);
+                        const int y = pose.bbox.y + rng.uniform(0, bbox_sz.height - occ_sz.height + 1);
+                        const cv::Point occ_tl(x, y);
+                        cv::rectangle(rscene, cv::Rect(occ_tl, occ_sz), cv::Scalar(rng.uniform(0, 256)), -1);
+                    }
+
+                    rvposes.push_back(pose);
+                }
+            }
+
+            if (rsettings.blur_sigma > 0.0)
+            {
+                cv::GaussianBlur(rscene, rscene, cv::Size(), rsettings.blur_sigma);
+            }
+
+            if (rsettings.noise_sigma > 0.0)
+            {
+                cv::Mat img_noise(rsettings.size, CV_16S);
+                cv::Mat img_sum;
+                rng.fill(img_noise, cv::RNG::NORMAL, 0.0, rsettings.noise_sigma);
+                rscene.convertTo(img_sum, CV_16S);
+                img_sum += img_noise;
+                img_sum.convertTo(rscene, CV_8U);
+            }
+
+            result = true;
+        }
+
+        return result;
+    }
+
+
+    bool save_scene_poses(const std::string& rsfile, const std::vector<ScenePose>& rvposes)
+    {
+        bool result = false;
+        cv::FileStorage fs(rsfile, cv::FileStorage::WRITE);
+        if (fs.isOpened())
+        {
+            fs << "poses" << "[";
+            for (const auto& rpose : rvposes)
+            {
+                fs << "{";
+                fs << "name" << rpose.name;
+                fs << "index" << rpose.index;
+                fs << "center" << rpose.center;
+                fs << "scale" << rpose.scale;
+                fs << "angle" << rpose.angle;
+                fs << "bbox" << rpose.bbox;
+                fs << "}";
+            }
+            fs << "]";
+            result = true;
+        }
+        return result;
+    }
+
+
+    bool load_scene_poses(const std::string& rsfile, std::vector<ScenePose>& rvposes)
+    {
+        bool result = false;
+        cv::FileStorage fs(rsfile, cv::FileStorage::READ);
+        if (fs.isOpened())
+        {
+            cv::FileNode node = fs["poses"];
+            for (auto iter = node.begin(); iter != node.end(); ++iter)
+            {
+                const cv::FileNode& rnode = *iter;
+                ScenePose pose;
+                rnode["name"] >> pose.name;
+                rnode["index"] >> pose.index;
+                rnode["center"] >> pose.center;
+                rnode["scale"] >> pose.scale;
+                rnode["angle"] >> pose.angle;
+                rnode["bbox"] >> pose.bbox;
+                rvposes.push_back(pose);
+            }
+            result = true;
+        }
+        return result;
+    }
+}
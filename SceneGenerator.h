@@ -0,0 +1,119 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SCENE_GENERATOR_H_
+#define SCENE_GENERATOR_H_
+
+#include <string>
+#include <vector>
+#include "opencv2/imgproc.hpp"
+
+
+namespace ghalgo
+{
+    // Settings for a synthetic scene.
+    class SceneSettings
+    {
+    public:
+        SceneSettings() :
+            size(640, 480),
+            background(-1),
+            ninstances(1),
+            clutter_density(0.0),
+            noise_sigma(0.0),
+            blur_sigma(0.0),
+            scale_min(1.0),
+            scale_max(1.0),
+            angle_max(0.0),
+            occlusion(0.0) {}
+        virtual ~SceneSettings() {}
+    public:
+        cv::Size size;              // size of scene
+        int background;             // gray level of background or -1 for level of first template's corner
+        int ninstances;             // number of templates to place in scene
+        double clutter_density;     // random shapes per 10000 pixels drawn under the templates
+                                    // (up to half the size of the smallest template)
+        double noise_sigma;         // standard deviation of Gaussian noise added last (0 for none)
+        double blur_sigma;          // standard deviation of Gaussian blur applied before noise (0 for none)
+        double scale_min;           // range of scale for each instance
+        double scale_max;
+        double angle_max;           // each instance is rotated by up to this many degrees either way
+        double occlusion;           // fraction of each instance covered by a random rectangle (0 for none)
+    };
+
+
+    // Ground truth for one template instance in a synthetic scene.
+    // The center is where the peak of the votes should be for a matching template.
+    class ScenePose
+    {
+    public:
+        ScenePose() : index(0), center(0, 0), scale(1.0), angle(0.0) {}
+        virtual ~ScenePose() {}
+    public:
+        std::string name;           // name of template
+        int index;                  // index of template in generator
+        cv::Point center;           // location of template center in scene
+        double scale;               // scale of template
+        double angle;               // counter-clockwise rotation of template in degrees
+        cv::Rect bbox;              // bounding box of template in scene
+    };
+
+
+    // Composites gray templates into synthetic scenes with known poses.
+    // Scenes only depend on the templates, the settings, and the seed so a set of scenes
+    // can be reproduced anywhere to compare matcher results.
+    class SceneGenerator
+    {
+    public:
+
+        SceneGenerator();
+        virtual ~SceneGenerator();
+
+        // Adds an 8-bit gray template image that can be placed in scenes.
+        // Returns false if image is not 8-bit gray.
+        bool add_template(const std::string& rsname, const cv::Mat& rimg);
+
+        size_t get_template_count(void) const { return m_templates.size(); }
+
+        // Creates an 8-bit gray scene and the pose of each template instance in it.
+        // Instances do not overlap.  If there is not room for all of them then fewer are placed.
+        // Returns false if there are no templates.
+        bool generate(
+            const SceneSettings& rsettings,
+            const uint64_t seed,
+            cv::Mat& rscene,
+            std::vector<ScenePose>& rvposes) const;
+
+    private:
+
+        std::vector<std::string> m_names;
+        std::vector<cv::Mat> m_templates;
+    };
+
+
+    // Saves or loads the poses of template instances in a scene.
+    // Returns false if file cannot be written or read.
+    bool save_scene_poses(const std::string& rsfile, const std::vector<ScenePose>& rvposes);
+    bool load_scene_poses(const std::string& rsfile, std::vector<ScenePose>& rvposes);
+}
+
+#endif // SCENE_GENERATOR_H_
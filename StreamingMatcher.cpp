@@ -0,0 +1,290 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "opencv2/imgproc.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "StreamingMatcher.h"
+
+
+namespace ghalgo
+{
+    StreamingMatcher::StreamingMatcher() :
+        m_width(0),
+        m_loopstep(1),
+        m_max_rows(1),
+        m_overlap(1),
+        m_magmax(0.0),
+        m_min_votes(0.0),
+        m_score_scale(0.0),
+        m_raw_row0(0),
+        m_raw_count(0),
+        m_rows_pushed(0),
+        m_next_key_row(0),
+        m_peak_rx(0),
+        m_peak_ry(0),
+        m_final_rows(0),
+        m_next_peak_row(0)
+    {
+    }
+
+
+    StreamingMatcher::~StreamingMatcher()
+    {
+    }
+
+
+    void StreamingMatcher::init(
+        std::shared_ptr<const CompiledTemplate> ptemplate,
+        const int width,
+        const std::function<void(const Detection&)>& rfunc,
+        const double magmax,
+        const double min_score,
+        const int loopstep,
+        const int max_rows)
+    {
+        m_ptemplate = ptemplate;
+        m_func = rfunc;
+        m_width = width;
+        m_loopstep = std::max(1, loopstep);
+        m_max_rows = std::max(1, max_rows);
+        m_magmax = magmax;
+        m_raw_row0 = 0;
+        m_raw_count = 0;
+        m_rows_pushed = 0;
+        m_next_key_row = 0;
+        m_final_rows = 0;
+        m_next_peak_row = 0;
+
+        if (m_ptemplate)
+        {
+            const TemplateParams& rparams = m_ptemplate->params;
+            const double loop_area = static_cast<double>(m_loopstep * m_loopstep);
+
+            // a row can be encoded once the rows that the blur and Sobel kernels reach below it have arrived
+            // (a Sobel kernel size of -1 is the 3x3 Scharr filter)
+            const int blur_reach = (rparams.kpreblur > 1) ? (rparams.kpreblur / 2) : 0;
+            m_overlap = blur_reach + std::max(1, rparams.ksobel / 2);
+
+            // raw rows are kept for the kernels above and below the rows still waiting to be encoded
+            m_raw = cv::Mat::zeros(m_max_rows + 2 * m_overlap, m_width, CV_8U);
+
+            // height of stream is not known so window votes into any row after the first
+            // it gets up to a batch of rows or the rows left at the end of the stream between releases
+            m_window.init(cv::Size(m_width, INT_MAX), m_ptemplate->table, std::max(m_max_rows, m_overlap));
+
+            // ideal max votes is reduced by the loop step in both directions
+            m_min_votes = (min_score * m_ptemplate->max_votes) / loop_area;
+            m_score_scale = (m_ptemplate->max_votes > 0.0) ? (loop_area / m_ptemplate->max_votes) : 0.0;
+
+            // a peak must be the highest vote within half a template size
+            m_peak_rx = m_ptemplate->table.img_sz.width / 2;
+            m_peak_ry = m_ptemplate->table.img_sz.height / 2;
+            m_peak_ring = cv::Mat::zeros(2 * m_peak_ry + 1, m_width, CV_16U);
+        }
+    }
+
+
+    bool StreamingMatcher::push_rows(const cv::Mat& rrows)
+    {
+        bool result = false;
+        if (m_ptemplate &&
+            (rrows.cols == m_width) &&
+            (rrows.depth() == CV_8U) &&
+            ((rrows.channels() == 1) || (rrows.channels() == 3)))
+        {
+            for (int r0 = 0; r0 < rrows.rows; r0 += m_max_rows)
+            {
+                const int r1 = std::min(r0 + m_max_rows, rrows.rows);
+                if (rrows.channels() == 3)
+                {
+                    cv::cvtColor(rrows.rowRange(r0, r1), m_gray, cv::COLOR_BGR2GRAY);
+                    append_raw_rows(m_gray);
+                }
+                else
+                {
+                    append_raw_rows(rrows.rowRange(r0, r1));
+                }
+                process_rows(false);
+            }
+            result = true;
+        }
+        return result;
+    }
+
+
+    void StreamingMatcher::flush(void)
+    {
+        if (m_ptemplate && (m_rows_pushed > 0))
+        {
+            // every remaining row can be encoded now that the bottom of the image is known
+            // and the rows that could not be checked for peaks have all of their neighbors
+            process_rows(true);
+            for (int t = m_next_peak_row; t < m_rows_pushed; ++t)
+            {
+                find_row_peaks(t, m_rows_pushed);
+            }
+            m_next_peak_row = m_rows_pushed;
+        }
+    }
+
+
+    void StreamingMatcher::append_raw_rows(const cv::Mat& rgray)
+    {
+        // slide up the raw rows that the kernels still need for rows waiting to be encoded
+        const int keep_row0 = std::max(m_raw_row0, m_next_key_row - m_overlap);
+        const int drop_count = keep_row0 - m_raw_row0;
+        const size_t row_bytes = m_raw.cols * m_raw.elemSize();
+        for (int k = drop_count; k < m_raw_count; ++k)
+        {
+            std::memcpy(m_raw.ptr(k - drop_count), m_raw.ptr(k), row_bytes);
+        }
+        m_raw_count -= drop_count;
+        m_raw_row0 = keep_row0;
+
+        // then append the new rows
+        rgray.copyTo(m_raw.rowRange(m_raw_count, m_raw_count + rgray.rows));
+        m_raw_count += rgray.rows;
+        m_rows_pushed += rgray.rows;
+    }
+
+
+    void StreamingMatcher::process_rows(const bool is_end)
+    {
+        const TemplateParams& rparams = m_ptemplate->params;
+        const int key_row_end = (is_end) ? m_rows_pushed : (m_rows_pushed - m_overlap);
+
+        if (key_row_end > m_next_key_row)
+        {
+            // the raw rows are a view of the top of the raw buffer so the blur is told to treat
+            // the view as a whole image and not read the unused rows below it
+            // (the blurred rows are a separate image so the Sobel kernels never see those rows)
+            const cv::Mat img_raw = m_raw.rowRange(0, m_raw_count);
+            if (rparams.kpreblur > 1)
+            {
+                GaussianBlur(img_raw, m_blur, { rparams.kpreblur, rparams.kpreblur }, 0, 0, cv::BORDER_DEFAULT | cv::BORDER_ISOLATED);
+            }
+            else
+            {
+                img_raw.copyTo(m_blur);
+            }
+
+            // the default maximum magnitude only comes from rows that are encoded now
+            // since the rows below them do not have all of the rows their kernels need yet
+            GradientMatcher::calc_gradients(rparams, m_ctx, m_blur);
+            if (m_magmax <= 0.0)
+            {
+                minMaxLoc(m_ctx.temp_mag.rowRange(m_next_key_row - m_raw_row0, key_row_end - m_raw_row0), nullptr, &m_magmax);
+            }
+            GradientMatcher::encode_gradients(rparams, m_ctx, m_magmax, m_key);
+
+            // the last row of the image does not vote (same as allpix)
+            for (int i = m_next_key_row; i < key_row_end; ++i)
+            {
+                if (!is_end || (i < (m_rows_pushed - 1)))
+                {
+                    m_window.add_row<uint8_t>(m_key.ptr<uint8_t>(i - m_raw_row0), i, m_loopstep);
+                }
+            }
+            m_next_key_row = key_row_end;
+        }
+
+        // vote rows past the rows pushed so far might not exist so they are held back
+        // until more rows arrive (only happens if every table offset points down)
+        const int row0 = m_window.get_first_row();
+        const int nfinal = (is_end) ?
+            (m_rows_pushed - row0) :
+            std::min(m_window.get_final_count(m_next_key_row), m_rows_pushed - row0);
+        if (nfinal > 0)
+        {
+            add_final_rows(m_window.get_rows(nfinal), row0);
+            m_window.release_rows(nfinal);
+        }
+    }
+
+
+    void StreamingMatcher::add_final_rows(const cv::Mat& rvotes, const int row)
+    {
+        const int nring = m_peak_ring.rows;
+        for (int k = 0; k < rvotes.rows; ++k)
+        {
+            rvotes.row(k).copyTo(m_peak_ring.row((row + k) % nring));
+            m_final_rows = row + k + 1;
+            if (m_row_func)
+            {
+                m_row_func(rvotes.row(k), row + k);
+            }
+
+            // ring now has every row within reach of the next row to check
+            while ((m_next_peak_row + m_peak_ry) < m_final_rows)
+            {
+                find_row_peaks(m_next_peak_row, m_final_rows);
+                m_next_peak_row++;
+            }
+        }
+    }
+
+
+    void StreamingMatcher::find_row_peaks(const int t, const int row_end)
+    {
+        const int nring = m_peak_ring.rows;
+        const int r0 = std::max(0, t - m_peak_ry);
+        const int r1 = std::min(row_end, t + m_peak_ry + 1);
+        const uint16_t * prow = m_peak_ring.ptr<uint16_t>(t % nring);
+
+        for (int c = 0; c < m_width; ++c)
+        {
+            const uint16_t v = prow[c];
+            if ((v > 0) && (v >= m_min_votes))
+            {
+                // a peak is the highest vote in its neighborhood
+                // and ties go to the first one in raster order
+                bool is_peak = true;
+                const int c0 = std::max(0, c - m_peak_rx);
+                const int c1 = std::min(m_width, c + m_peak_rx + 1);
+                for (int rr = r0; is_peak && (rr < r1); ++rr)
+                {
+                    const uint16_t * pnbr = m_peak_ring.ptr<uint16_t>(rr % nring);
+                    for (int cc = c0; is_peak && (cc < c1); ++cc)
+                    {
+                        const uint16_t u = pnbr[cc];
+                        if ((u > v) || ((u == v) && ((rr < t) || ((rr == t) && (cc < c)))))
+                        {
+                            is_peak = false;
+                        }
+                    }
+                }
+
+                if (is_peak)
+                {
+                    Detection det;
+                    det.row = t;
+                    det.col = c;
+                    det.votes = static_cast<double>(v);
+                    det.score = det.votes * m_score_scale;
+                    m_func(det);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,146 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef STREAMING_MATCHER_H_
+#define STREAMING_MATCHER_H_
+
+#include <functional>
+#include <memory>
+#include "GradientMatcher.h"
+
+
+namespace ghalgo
+{
+    // A template match found in a stream of image rows.
+    class Detection
+    {
+    public:
+        Detection() : row(0), col(0), votes(0.0), score(0.0) {}
+        virtual ~Detection() {}
+    public:
+        int row;            // row number counting from first row pushed since init
+        int col;
+        double votes;
+        double score;       // votes relative to ideal max votes for template (adjusted for loop step)
+    };
+
+
+    // Matches a template against an endless stream of image rows such as the output of a line-scan camera.
+    // Rows are pushed in batches of any size.  Each row is encoded and votes as soon as the rows needed by
+    // the blur and Sobel kernels below it have arrived.  A vote row is final when no later row can vote in it
+    // and it is checked for peaks when the rows within half a template height below it are also final.
+    // Each peak is passed to a callback once so memory use stays the same no matter how many rows are pushed.
+    // The results are the same as matching the whole image with the same fixed maximum magnitude
+    // (GradientMatcher uses the maximum in the whole image, which is not known until the end of the stream).
+    // The CLAHE pre-processing setting is ignored because it depends on the whole image.
+    // Row numbers are int so a stream must be restarted with init before 2^31 rows have been pushed.
+    class StreamingMatcher
+    {
+    public:
+
+        StreamingMatcher();
+        virtual ~StreamingMatcher();
+
+        // Starts a new stream of rows with the given width.
+        // The gradient magnitude threshold is relative to magmax.  If it is 0 then the maximum magnitude
+        // in the first rows that get encoded is used instead.  Only rows that have all of the rows the blur
+        // and Sobel kernels need are used, so unlike GradientMatcher it does not see the whole image
+        // and how many rows it sees depends on the size of the first batches.
+        // Peaks must have at least min_score of the ideal max votes.
+        // Batches larger than max_rows are processed in pieces.
+        void init(
+            std::shared_ptr<const CompiledTemplate> ptemplate,
+            const int width,
+            const std::function<void(const Detection&)>& rfunc,
+            const double magmax = 0.0,
+            const double min_score = 0.5,
+            const int loopstep = 1,
+            const int max_rows = 64);
+
+        // Adds 8-bit gray or BGR rows to the bottom of the stream.
+        // Returns false if there is no template or the rows are the wrong width.
+        bool push_rows(const cv::Mat& rrows);
+
+        // Ends the stream so the last row pushed is the bottom of the image.
+        // Any remaining detections are passed to the callback.  Call init to start another stream.
+        void flush(void);
+
+        // Sets an optional callback that gets each vote row once it is final, with its row number.
+        // The row is only valid during the call.  It is kept when init starts another stream.
+        void set_vote_row_func(const std::function<void(const cv::Mat&, const int)>& rfunc) { m_row_func = rfunc; }
+
+        int get_rows_pushed(void) const { return m_rows_pushed; }
+
+        // Returns the magnitude that the threshold is relative to (0 until first rows are encoded).
+        double get_magmax(void) const { return m_magmax; }
+
+    private:
+
+        // Drops raw rows that are no longer needed and appends a batch of gray rows.
+        void append_raw_rows(const cv::Mat& rgray);
+
+        // Encodes and votes with the raw rows that are ready and handles any vote rows that become final.
+        // At the end of the stream every remaining row is ready.
+        void process_rows(const bool is_end);
+
+        // Copies final vote rows to the peak ring and checks the rows that have enough final rows below them.
+        void add_final_rows(const cv::Mat& rvotes, const int row);
+
+        // Passes row t to the callback if it has any peaks.  Rows at or after row_end do not exist.
+        void find_row_peaks(const int t, const int row_end);
+
+        std::shared_ptr<const CompiledTemplate> m_ptemplate;
+        std::function<void(const Detection&)> m_func;
+        std::function<void(const cv::Mat&, const int)> m_row_func;
+        MatcherContext m_ctx;
+
+        int m_width;
+        int m_loopstep;
+        int m_max_rows;
+        int m_overlap;
+        double m_magmax;
+        double m_min_votes;
+        double m_score_scale;
+
+        // recent raw rows (starting at image row m_raw_row0) that are still needed by the kernels
+        cv::Mat m_raw;
+        cv::Mat m_gray;
+        cv::Mat m_blur;
+        cv::Mat m_key;
+        int m_raw_row0;
+        int m_raw_count;
+        int m_rows_pushed;
+        int m_next_key_row;
+
+        // vote rows that may still get votes
+        RollingVoteWindow<CV_16U, uint16_t> m_window;
+
+        // ring of final vote rows that are within reach of the row being checked for peaks
+        cv::Mat m_peak_ring;
+        int m_peak_rx;
+        int m_peak_ry;
+        int m_final_rows;
+        int m_next_peak_row;
+    };
+}
+
+#endif // STREAMING_MATCHER_H_
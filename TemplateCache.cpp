@@ -0,0 +1,214 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <exception>
+#include <tuple>
+#include "TemplateCache.h"
+
+
+namespace ghalgo
+{
+    bool TemplateKey::operator<(const TemplateKey& rother) const
+    {
+        const TemplateParams& a = params;
+        const TemplateParams& b = rother.params;
+        return
+            std::tie(sfile, prescale, a.kpreblur, a.ksobel, a.magthr, a.angstep, a.is_pre_CLAHE_enabled, a.CLAHE_clip_limit, a.subsample, a.max_bytes, a.budget_policy) <
+            std::tie(rother.sfile, rother.prescale, b.kpreblur, b.ksobel, b.magthr, b.angstep, b.is_pre_CLAHE_enabled, b.CLAHE_clip_limit, b.subsample, b.max_bytes, b.budget_policy);
+    }
+
+
+    TemplateCache::TemplateCache(const size_t budget_bytes) :
+        m_budget_bytes(budget_bytes),
+        m_bytes_used(0),
+        m_hits(0),
+        m_misses(0)
+    {
+    }
+
+
+    TemplateCache::~TemplateCache()
+    {
+        // wait for any background compilations since they may still be running
+        for (auto& rpair : m_pending)
+        {
+            rpair.second.wait();
+        }
+    }
+
+
+    bool TemplateCache::get(
+        const TemplateKey& rkey,
+        cv::Mat& rtemplate_image,
+        std::shared_ptr<const CompiledTemplate>& rptemplate)
+    {
+        bool result = false;
+        std::shared_future<CacheEntry> pending;
+        CacheEntry entry;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        collect_ready();
+
+        auto iter = m_entries.find(rkey);
+        if (iter != m_entries.end())
+        {
+            // cache hit so move key to front of LRU list
+            m_lru.splice(m_lru.begin(), m_lru, iter->second.second);
+            entry = iter->second.first;
+            m_hits++;
+            result = true;
+        }
+        else
+        {
+            auto iter_pending = m_pending.find(rkey);
+            if (iter_pending != m_pending.end())
+            {
+                // already being compiled so wait for it without holding lock
+                pending = iter_pending->second;
+                lock.unlock();
+                entry = pending.get();
+                lock.lock();
+                m_pending.erase(rkey);
+                result = static_cast<bool>(entry.ptemplate);
+                m_hits += (result) ? 1 : 0;
+                m_misses += (result) ? 0 : 1;
+            }
+            else
+            {
+                // compile it now without holding lock
+                // it is registered as pending first so other threads wait for it instead of compiling it again
+                std::promise<CacheEntry> compiling;
+                m_pending[rkey] = compiling.get_future().share();
+                lock.unlock();
+                entry = compile(rkey);
+                compiling.set_value(entry);
+                lock.lock();
+                m_pending.erase(rkey);
+                m_misses++;
+            }
+            insert(rkey, entry);
+        }
+
+        rtemplate_image = entry.template_image;
+        rptemplate = entry.ptemplate;
+        return result;
+    }
+
+
+    void TemplateCache::prefetch(const TemplateKey& rkey)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        collect_ready();
+        if ((m_entries.count(rkey) == 0) && (m_pending.count(rkey) == 0))
+        {
+            m_pending[rkey] = std::async(std::launch::async, TemplateCache::compile, rkey).share();
+        }
+    }
+
+
+    void TemplateCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_lru.clear();
+        m_bytes_used = 0;
+    }
+
+
+    void TemplateCache::set_budget(const size_t budget_bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget_bytes = budget_bytes;
+        evict();
+    }
+
+
+    TemplateCache::CacheEntry TemplateCache::compile(const TemplateKey& rkey)
+    {
+        // use a private matcher so nothing is shared with other threads
+        GradientMatcher matcher;
+        CacheEntry entry;
+        matcher.set_params(rkey.params);
+        try
+        {
+            entry.ptemplate = matcher.compile_template_file(entry.template_image, rkey.sfile, rkey.prescale);
+        }
+        catch (const std::exception&)
+        {
+            // an exception stored in a shared future would be thrown again every time it was read
+            // so a failure is just a missing template
+            entry = CacheEntry();
+        }
+        if (entry.ptemplate)
+        {
+            entry.bytes = get_mat_bytes(entry.template_image) + entry.ptemplate->memory_usage();
+        }
+        return entry;
+    }
+
+
+    void TemplateCache::insert(const TemplateKey& rkey, const CacheEntry& rentry)
+    {
+        // another thread may have inserted the same template while the lock was released
+        // failures are not cached so a missing file can be fixed and tried again
+        if (rentry.ptemplate && (m_entries.count(rkey) == 0))
+        {
+            m_lru.push_front(rkey);
+            m_entries[rkey] = std::make_pair(rentry, m_lru.begin());
+            m_bytes_used += rentry.bytes;
+            evict();
+        }
+    }
+
+
+    void TemplateCache::collect_ready(void)
+    {
+        // move any finished background compilations into the cache
+        auto iter = m_pending.begin();
+        while (iter != m_pending.end())
+        {
+            if (iter->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                insert(iter->first, iter->second.get());
+                iter = m_pending.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+
+    void TemplateCache::evict(void)
+    {
+        // discard least recently used templates until cache fits in budget
+        // but always keep the most recent one since it is probably in use
+        while ((m_bytes_used > m_budget_bytes) && (m_lru.size() > 1))
+        {
+            auto iter = m_entries.find(m_lru.back());
+            m_bytes_used -= iter->second.first.bytes;
+            m_entries.erase(iter);
+            m_lru.pop_back();
+        }
+    }
+}
@@ -0,0 +1,123 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef TEMPLATE_CACHE_H_
+#define TEMPLATE_CACHE_H_
+
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include "GradientMatcher.h"
+
+
+namespace ghalgo
+{
+    // Everything that affects the table compiled from a template file.
+    class TemplateKey
+    {
+    public:
+        TemplateKey(const std::string& rsfile, const double prescale, const TemplateParams& rparams) :
+            sfile(rsfile),
+            prescale(prescale),
+            params(rparams) {}
+        virtual ~TemplateKey() {}
+        bool operator<(const TemplateKey& rother) const;
+    public:
+        std::string sfile;
+        double prescale;
+        TemplateParams params;
+    };
+
+
+    // Cache of compiled templates with a memory budget and least-recently-used eviction.
+    // Templates can be compiled in the background before they are needed.
+    // All methods are thread-safe.  Compilation is done outside the lock.
+    class TemplateCache
+    {
+    public:
+
+        TemplateCache(const size_t budget_bytes = 64 * 1024 * 1024);
+        virtual ~TemplateCache();
+
+        // Gets compiled template for a file and settings.  It is compiled if it is not in the cache.
+        // If it is being compiled in the background or by another call then this waits for it to finish.
+        // The image loaded from the file is passed back.  Returns true if it was already available.
+        // If the template cannot be compiled then a null pointer is passed back and nothing is cached
+        // so it will be tried again next time.
+        bool get(
+            const TemplateKey& rkey,
+            cv::Mat& rtemplate_image,
+            std::shared_ptr<const CompiledTemplate>& rptemplate);
+
+        // Starts compiling a template in the background if it is not already cached or being compiled.
+        void prefetch(const TemplateKey& rkey);
+
+        // Discards all cached templates.  Background compilations are allowed to finish.
+        void clear();
+
+        // Changing the budget evicts templates if necessary.
+        void set_budget(const size_t budget_bytes);
+
+        size_t get_budget(void) const { std::lock_guard<std::mutex> lock(m_mutex); return m_budget_bytes; }
+        size_t get_bytes_used(void) const { std::lock_guard<std::mutex> lock(m_mutex); return m_bytes_used; }
+        size_t get_count(void) const { std::lock_guard<std::mutex> lock(m_mutex); return m_entries.size(); }
+        size_t get_hits(void) const { std::lock_guard<std::mutex> lock(m_mutex); return m_hits; }
+        size_t get_misses(void) const { std::lock_guard<std::mutex> lock(m_mutex); return m_misses; }
+
+    private:
+
+        class CacheEntry
+        {
+        public:
+            CacheEntry() : bytes(0) {}
+            cv::Mat template_image;
+            std::shared_ptr<const CompiledTemplate> ptemplate;
+            size_t bytes;
+        };
+
+        typedef std::list<TemplateKey> T_lru_list;
+
+        // Compiles a template.  Any error gives an entry with a null pointer (it never throws).
+        static CacheEntry compile(const TemplateKey& rkey);
+
+        // these must be called with the lock held
+        void insert(const TemplateKey& rkey, const CacheEntry& rentry);
+        void collect_ready(void);
+        void evict(void);
+
+        mutable std::mutex m_mutex;
+
+        // Most recently used key is at front of list
+        T_lru_list m_lru;
+        std::map<TemplateKey, std::pair<CacheEntry, T_lru_list::iterator>> m_entries;
+        std::map<TemplateKey, std::shared_future<CacheEntry>> m_pending;
+
+        size_t m_budget_bytes;
+        size_t m_bytes_used;
+        size_t m_hits;
+        size_t m_misses;
+    };
+}
+
+#endif // TEMPLATE_CACHE_H_
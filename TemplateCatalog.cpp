@@ -0,0 +1,199 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "TemplateCatalog.h"
+
+
+namespace ghalgo
+{
+    void get_table_stats(const ghalgo::LookupTable& rtable, TemplateStats& rstats)
+    {
+        rstats.max_votes = rtable.max_votes;
+        rstats.keys_used = static_cast<int>(rtable.keys_used);
+        rstats.extents = rtable.extents;
+    }
+
+
+    bool load_catalog_settings(const std::string& rsfile, std::vector<T_file_info>& rvinfo)
+    {
+        bool result = false;
+        cv::FileStorage fs(rsfile, cv::FileStorage::READ);
+        if (fs.isOpened())
+        {
+            cv::FileNode node = fs["templates"];
+            for (auto iter = node.begin(); iter != node.end(); ++iter)
+            {
+                T_file_info info;
+                (*iter)["name"] >> info.sname;
+                (*iter)["mag_thr"] >> info.mag_thr;
+                (*iter)["img_scale"] >> info.img_scale;
+                rvinfo.push_back(info);
+            }
+            result = true;
+        }
+        return result;
+    }
+
+
+    void compile_catalog(
+        const std::string& rspath,
+        const std::vector<T_file_info>& rvinfo,
+        const TemplateParams& rparams,
+        std::vector<CatalogItem>& rvitems,
+        const int nthreads)
+    {
+        std::atomic<size_t> next_index(0);
+        std::vector<std::thread> vthreads;
+
+        rvitems.clear();
+        rvitems.resize(rvinfo.size());
+
+        // each worker pulls the next file from the list until all are done
+        // each worker has its own matcher and writes only to its own items
+        auto worker = [&]()
+        {
+            GradientMatcher matcher;
+            for (size_t ii = next_index++; ii < rvinfo.size(); ii = next_index++)
+            {
+                CatalogItem& ritem = rvitems[ii];
+                TemplateParams params = rparams;
+                cv::Mat template_image;
+                ritem.info = rvinfo[ii];
+                params.magthr = ritem.info.mag_thr;
+                matcher.set_params(params);
+
+                int64_t t0 = cv::getTickCount();
+                ritem.ptemplate = matcher.compile_template_file(template_image, rspath + ritem.info.sname, ritem.info.img_scale);
+                int64_t t1 = cv::getTickCount();
+
+                if (ritem.ptemplate)
+                {
+                    get_table_stats(ritem.ptemplate->table, ritem.stats);
+                    ritem.stats.msec = (1000.0 * (t1 - t0)) / cv::getTickFrequency();
+                }
+            }
+        };
+
+        size_t ncores = (nthreads > 0) ? static_cast<size_t>(nthreads) : std::thread::hardware_concurrency();
+        ncores = std::max<size_t>(1, std::min(ncores, rvinfo.size()));
+        for (size_t ii = 0; ii < ncores; ++ii)
+        {
+            vthreads.push_back(std::thread(worker));
+        }
+        for (auto& rthread : vthreads)
+        {
+            rthread.join();
+        }
+    }
+
+
+    bool save_catalog(const std::string& rsfile, const std::vector<CatalogItem>& rvitems)
+    {
+        bool result = false;
+        cv::FileStorage fs(rsfile, cv::FileStorage::WRITE);
+        if (fs.isOpened())
+        {
+            fs << "templates" << "[";
+            for (const auto& ritem : rvitems)
+            {
+                if (ritem.ptemplate)
+                {
+                    const TemplateParams& rparams = ritem.ptemplate->params;
+                    const LookupTable& rtable = ritem.ptemplate->table;
+                    fs << "{";
+                    fs << "name" << ritem.info.sname;
+                    fs << "mag_thr" << ritem.info.mag_thr;
+                    fs << "img_scale" << ritem.info.img_scale;
+                    fs << "kpreblur" << rparams.kpreblur;
+                    fs << "ksobel" << rparams.ksobel;
+                    fs << "magthr" << rparams.magthr;
+                    fs << "angstep" << rparams.angstep;
+                    fs << "is_pre_CLAHE_enabled" << static_cast<int>(rparams.is_pre_CLAHE_enabled);
+                    fs << "CLAHE_clip_limit" << rparams.CLAHE_clip_limit;
+                    fs << "subsample" << rparams.subsample;
+                    fs << "img_sz" << rtable.img_sz;
+                    fs << "elems" << "[";
+                    for (const auto& rvec : rtable.elems)
+                    {
+                        fs << rvec;
+                    }
+                    fs << "]";
+                    fs << "}";
+                }
+            }
+            fs << "]";
+            result = true;
+        }
+        return result;
+    }
+
+
+    bool load_catalog(const std::string& rsfile, std::vector<CatalogItem>& rvitems)
+    {
+        bool result = false;
+        cv::FileStorage fs(rsfile, cv::FileStorage::READ);
+        if (fs.isOpened())
+        {
+            cv::FileNode node = fs["templates"];
+            for (auto iter = node.begin(); iter != node.end(); ++iter)
+            {
+                const cv::FileNode& rnode = *iter;
+                CatalogItem item;
+                TemplateParams params;
+                LookupTable table;
+                int is_CLAHE_enabled = (params.is_pre_CLAHE_enabled) ? 1 : 0;
+
+                rnode["name"] >> item.info.sname;
+                rnode["mag_thr"] >> item.info.mag_thr;
+                rnode["img_scale"] >> item.info.img_scale;
+                rnode["kpreblur"] >> params.kpreblur;
+                rnode["ksobel"] >> params.ksobel;
+                rnode["magthr"] >> params.magthr;
+                rnode["angstep"] >> params.angstep;
+                rnode["is_pre_CLAHE_enabled"] >> is_CLAHE_enabled;
+                rnode["CLAHE_clip_limit"] >> params.CLAHE_clip_limit;
+                rnode["subsample"] >> params.subsample;
+                rnode["img_sz"] >> table.img_sz;
+                params.is_pre_CLAHE_enabled = (is_CLAHE_enabled != 0);
+
+                // restore the table entries then the vote count and metadata
+                cv::FileNode elems_node = rnode["elems"];
+                for (auto iter_elem = elems_node.begin(); iter_elem != elems_node.end(); ++iter_elem)
+                {
+                    std::vector<cv::Point> vec;
+                    (*iter_elem) >> vec;
+                    table.elems.push_back(vec);
+                }
+                table.update_metadata();
+
+                item.ptemplate = std::make_shared<const CompiledTemplate>(params, table);
+                get_table_stats(item.ptemplate->table, item.stats);
+                rvitems.push_back(item);
+            }
+            result = true;
+        }
+        return result;
+    }
+}
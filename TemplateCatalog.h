@@ -0,0 +1,91 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef TEMPLATE_CATALOG_H_
+#define TEMPLATE_CATALOG_H_
+
+#include <vector>
+#include "GradientMatcher.h"
+#include "util.h"
+
+
+namespace ghalgo
+{
+    // Statistics for a compiled template.
+    class TemplateStats
+    {
+    public:
+        TemplateStats() : max_votes(0), keys_used(0), extents(), msec(0.0) {}
+        virtual ~TemplateStats() {}
+    public:
+        // number of entries in table (one vote each)
+        size_t max_votes;
+        // number of keys with at least one entry
+        int keys_used;
+        // bounding box of all vote offsets
+        cv::Rect extents;
+        // time to compile template (0 if it was loaded from a file)
+        double msec;
+    };
+
+
+    // One template in a catalog with the per-file settings used to compile it.
+    // The template pointer is null if the file could not be compiled.
+    class CatalogItem
+    {
+    public:
+        CatalogItem() {}
+        virtual ~CatalogItem() {}
+    public:
+        T_file_info info;
+        std::shared_ptr<const CompiledTemplate> ptemplate;
+        TemplateStats stats;
+    };
+
+
+    // Calculates statistics for a lookup table.
+    void get_table_stats(const ghalgo::LookupTable& rtable, TemplateStats& rstats);
+
+    // Reads per-file settings (name, magnitude threshold, scale) from an OpenCV YAML or XML file.
+    // Returns false if file cannot be read.
+    bool load_catalog_settings(const std::string& rsfile, std::vector<T_file_info>& rvinfo);
+
+    // Compiles a collection of template files in parallel.
+    // The settings for each file override the magnitude threshold in the common settings.
+    // The path is prepended to each file name.  A thread count of 0 means use all cores.
+    void compile_catalog(
+        const std::string& rspath,
+        const std::vector<T_file_info>& rvinfo,
+        const TemplateParams& rparams,
+        std::vector<CatalogItem>& rvitems,
+        const int nthreads = 0);
+
+    // Writes all compiled templates to a single OpenCV YAML or XML file.
+    // Items that failed to compile are skipped.  Returns false if file cannot be written.
+    bool save_catalog(const std::string& rsfile, const std::vector<CatalogItem>& rvitems);
+
+    // Reads compiled templates from a file made by save_catalog.
+    // Returns false if file cannot be read.
+    bool load_catalog(const std::string& rsfile, std::vector<CatalogItem>& rvitems);
+}
+
+#endif // TEMPLATE_CATALOG_H_
@@ -0,0 +1,322 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "opencv2/imgproc.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include "SceneGenerator.h"
+#include "StreamingMatcher.h"
+#include "Verifier.h"
+
+
+namespace ghalgo
+{
+    // Adds bytes to a 64-bit FNV-1a checksum.
+    static uint64_t add_fnv1a_bytes(const uint8_t * pdata, const size_t n, const uint64_t hash)
+    {
+        const uint64_t FNV_PRIME = 1099511628211ULL;
+        uint64_t result = hash;
+        for (size_t k = 0; k < n; ++k)
+        {
+            result = (result ^ pdata[k]) * FNV_PRIME;
+        }
+        return result;
+    }
+
+    static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+
+
+    // Generates a synthetic scene with a template placed at a random location.
+    // The background level is the level of the template's corner so the template has no border edges
+    // unless other things are drawn next to it.
+    static void make_verify_scene(
+        const int scene,
+        const std::string& rsname,
+        const cv::Mat& rimg,
+        const uint64_t seed,
+        cv::Mat& rscene)
+    {
+        SceneGenerator generator;
+        SceneSettings settings;
+        std::vector<ScenePose> vposes;
+        generator.add_template(rsname, rimg);
+        settings.size = cv::Size(std::max(160, 3 * rimg.cols), std::max(120, 3 * rimg.rows));
+        settings.noise_sigma = (scene == VERIFY_SCENE_NOISY) ? 12.0 : 0.0;
+        settings.clutter_density = (scene == VERIFY_SCENE_CLUTTERED) ? 10.0 : 0.0;
+        settings.occlusion = (scene == VERIFY_SCENE_OCCLUDED) ? 0.25 : 0.0;
+        generator.generate(settings, seed, rscene, vposes);
+    }
+
+
+    // Appends a mismatch to a result if a vote image is not the same size and type as the reference
+    // or has any vote that differs from it.  The first different vote in raster order is described.
+    static void check_votes(
+        const char * sname,
+        const cv::Mat& rref,
+        const cv::Mat& rvotes,
+        VerifyResult& rresult)
+    {
+        char sbuf[128];
+        if ((rref.size() != rvotes.size()) || (rref.type() != rvotes.type()))
+        {
+            std::snprintf(sbuf, sizeof(sbuf), "%s, size or type differs", sname);
+            rresult.mismatches.push_back(sbuf);
+        }
+        else
+        {
+            const cv::Mat img_diff = (rref != rvotes);
+            bool is_found = false;
+            for (int i = 0; !is_found && (i < img_diff.rows); ++i)
+            {
+                const uint8_t * pdiff = img_diff.ptr<uint8_t>(i);
+                for (int j = 0; !is_found && (j < img_diff.cols); ++j)
+                {
+                    if (pdiff[j])
+                    {
+                        // vote images are always 16-bit
+                        std::snprintf(sbuf, sizeof(sbuf), "%s, first difference at (%d, %d) is %d instead of %d",
+                            sname, j, i, rvotes.at<uint16_t>(i, j), rref.at<uint16_t>(i, j));
+                        rresult.mismatches.push_back(sbuf);
+                        is_found = true;
+                    }
+                }
+            }
+        }
+    }
+
+
+    const char * get_verify_scene_name(const int n)
+    {
+        static const char * snames[VERIFY_SCENE_COUNT] = { "translated", "noisy", "cluttered", "occluded" };
+        return ((n >= 0) && (n < VERIFY_SCENE_COUNT)) ? snames[n] : "unknown";
+    }
+
+
+    uint64_t get_image_checksum(const cv::Mat& rimg)
+    {
+        uint64_t result = FNV_OFFSET_BASIS;
+        const size_t row_bytes = rimg.cols * rimg.elemSize();
+        for (int i = 0; i < rimg.rows; ++i)
+        {
+            result = add_fnv1a_bytes(rimg.ptr<uint8_t>(i), row_bytes, result);
+        }
+        return result;
+    }
+
+
+    void verify_template(
+        const std::string& rsname,
+        const cv::Mat& rimg,
+        const VerifySettings& rsettings,
+        std::vector<VerifyResult>& rvresults)
+    {
+        const int STRIP_ROWS = 16;
+        const int STREAM_ROWS = 16;
+
+        MatcherContext ctx;
+        ctx.engine.set_thread_count(rsettings.nthreads);
+
+        for (int scene = 0; scene < VERIFY_SCENE_COUNT; ++scene)
+        {
+            // each scene only depends on the seed, the template name, and the scene type
+            cv::Mat img_scene;
+            const uint64_t name_hash = add_fnv1a_bytes(reinterpret_cast<const uint8_t *>(rsname.data()), rsname.size(), FNV_OFFSET_BASIS);
+            make_verify_scene(scene, rsname, rimg, rsettings.seed ^ name_hash ^ static_cast<uint64_t>(scene), img_scene);
+
+            for (const double angstep : rsettings.angsteps)
+            {
+                // compile template and encode scene with default settings for the angle step
+                cv::Mat img_template;
+                cv::Mat img_pre;
+                cv::Mat img_key;
+                const TemplateParams params(7, 7, 0.2, angstep);
+                GradientMatcher::pre_process(params, rimg, img_template);
+                GradientMatcher::create_masked_gradient_orientation_img(params, ctx, img_template, img_key);
+                const std::shared_ptr<const CompiledTemplate> ptemplate = std::make_shared<const CompiledTemplate>(params, img_key);
+                const CompiledTemplate& ctemplate = *ptemplate;
+                double magmax;
+                GradientMatcher::pre_process(params, img_scene, img_pre);
+                GradientMatcher::create_masked_gradient_orientation_img(params, ctx, img_pre, img_key);
+                minMaxLoc(ctx.temp_mag, nullptr, &magmax);
+
+                for (int loopstep = 1; loopstep <= rsettings.max_loopstep; ++loopstep)
+                {
+                    char sbuf[64];
+                    VerifyResult result;
+                    cv::Mat img_ref;
+                    cv::Mat img_votes;
+                    std::snprintf(sbuf, sizeof(sbuf), "/%s/ang%g/step%d", get_verify_scene_name(scene), angstep, loopstep);
+                    result.name = rsname + sbuf;
+
+                    apply_ghough_transform_allpix<uint8_t, CV_16U, uint16_t>(img_key, img_ref, ctemplate.table, loopstep);
+                    result.checksum = get_image_checksum(img_ref);
+                    minMaxLoc(img_ref, nullptr, &result.qmax, nullptr, &result.ptmax);
+
+                    // every engine is forced to run even if it would not be picked automatically
+                    for (int engine = VoteEngine::AUTO + 1; engine < VoteEngine::COUNT; ++engine)
+                    {
+                        ctx.engine.set_engine(engine);
+                        ctx.engine.apply(img_key, img_votes, ctemplate.table, loopstep);
+                        check_votes(VoteEngine::get_engine_name(engine), img_ref, img_votes, result);
+                    }
+
+                    // the FFT engine only uses DFTs for keys where they pay off and these scenes are small
+                    // so it is also run with a DFT forced for every key
+                    ctx.engine.set_engine(VoteEngine::FFT);
+                    ctx.engine.set_dft_cost_scale(0.0);
+                    ctx.engine.apply(img_key, img_votes, ctemplate.table, loopstep);
+                    ctx.engine.set_dft_cost_scale(1.0);
+                    check_votes("fft-dft", img_ref, img_votes, result);
+
+                    // strip matcher encodes its own strips so this also checks the overlap between strips
+                    img_votes = cv::Mat::zeros(img_ref.size(), CV_16U);
+                    GradientMatcher::apply_ghough_strips(ctemplate, ctx, img_pre, STRIP_ROWS,
+                        [&img_votes](const StripResult& r)
+                    {
+                        r.votes.copyTo(img_votes.rowRange(r.row, r.row + r.votes.rows));
+                    }, loopstep);
+                    check_votes("strips", img_ref, img_votes, result);
+
+                    // streaming matcher is fed the scene in batches of rows and blurs and encodes them itself
+                    // so it gets the maximum magnitude of the whole scene to use the same threshold
+                    StreamingMatcher stream;
+                    img_votes = cv::Mat::zeros(img_ref.size(), CV_16U);
+                    stream.set_vote_row_func([&img_votes](const cv::Mat& rvotes, const int row)
+                    {
+                        rvotes.copyTo(img_votes.row(row));
+                    });
+                    stream.init(ptemplate, img_scene.cols, [](const Detection&) {}, magmax, 1.0, loopstep, STREAM_ROWS);
+                    for (int r0 = 0; r0 < img_scene.rows; r0 += STREAM_ROWS)
+                    {
+                        stream.push_rows(img_scene.rowRange(r0, std::min(r0 + STREAM_ROWS, img_scene.rows)));
+                    }
+                    stream.flush();
+                    check_votes("stream", img_ref, img_votes, result);
+
+                    rvresults.push_back(result);
+                }
+            }
+        }
+    }
+
+
+    bool save_golden_results(const std::string& rsfile, const std::vector<VerifyResult>& rvresults)
+    {
+        bool result = false;
+        cv::FileStorage fs(rsfile, cv::FileStorage::WRITE);
+        if (fs.isOpened())
+        {
+            fs << "cases" << "[";
+            for (const auto& rresult : rvresults)
+            {
+                // checksum is written as hex string since the file format has no 64-bit integers
+                char sbuf[32];
+                std::snprintf(sbuf, sizeof(sbuf), "%016llx", static_cast<unsigned long long>(rresult.checksum));
+                fs << "{";
+                fs << "name" << rresult.name;
+                fs << "checksum" << std::string(sbuf);
+                fs << "qmax" << rresult.qmax;
+                fs << "ptmax" << rresult.ptmax;
+                fs << "}";
+            }
+            fs << "]";
+            result = true;
+        }
+        return result;
+    }
+
+
+    bool load_golden_results(const std::string& rsfile, std::vector<VerifyResult>& rvresults)
+    {
+        bool result = false;
+        cv::FileStorage fs(rsfile, cv::FileStorage::READ);
+        if (fs.isOpened())
+        {
+            cv::FileNode node = fs["cases"];
+            for (auto iter = node.begin(); iter != node.end(); ++iter)
+            {
+                const cv::FileNode& rnode = *iter;
+                VerifyResult item;
+                std::string schecksum;
+                rnode["name"] >> item.name;
+                rnode["checksum"] >> schecksum;
+                rnode["qmax"] >> item.qmax;
+                rnode["ptmax"] >> item.ptmax;
+                item.checksum = std::strtoull(schecksum.c_str(), nullptr, 16);
+                rvresults.push_back(item);
+            }
+            result = true;
+        }
+        return result;
+    }
+
+
+    int compare_golden_results(
+        const std::vector<VerifyResult>& rvgolden,
+        const std::vector<VerifyResult>& rvresults,
+        std::vector<std::string>& rvdiffs)
+    {
+        int result = 0;
+        std::map<std::string, const VerifyResult *> golden_map;
+        for (const auto& rgolden : rvgolden)
+        {
+            golden_map[rgolden.name] = &rgolden;
+        }
+
+        for (const auto& rresult : rvresults)
+        {
+            auto iter = golden_map.find(rresult.name);
+            if (iter == golden_map.end())
+            {
+                rvdiffs.push_back(rresult.name + ":  not in golden results");
+                result++;
+            }
+            else
+            {
+                const VerifyResult& rgolden = *iter->second;
+                if (rgolden.checksum != rresult.checksum)
+                {
+                    rvdiffs.push_back(rresult.name + ":  votes differ from golden results");
+                    result++;
+                }
+                else if ((rgolden.qmax != rresult.qmax) || (rgolden.ptmax != rresult.ptmax))
+                {
+                    rvdiffs.push_back(rresult.name + ":  peak differs from golden results");
+                    result++;
+                }
+                golden_map.erase(iter);
+            }
+        }
+
+        // anything left was not run
+        for (const auto& rpair : golden_map)
+        {
+            rvdiffs.push_back(rpair.first + ":  missing from results");
+            result++;
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,107 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef VERIFIER_H_
+#define VERIFIER_H_
+
+#include <string>
+#include <vector>
+#include "GradientMatcher.h"
+
+
+namespace ghalgo
+{
+    // Settings for verifying the voting engines against the reference transform.
+    class VerifySettings
+    {
+    public:
+        VerifySettings() :
+            angsteps({ 8.0, 16.0, 32.0 }),
+            max_loopstep(4),
+            nthreads(2),
+            seed(1) {}
+        virtual ~VerifySettings() {}
+    public:
+        std::vector<double> angsteps;   // angle steps for the template keys
+        int max_loopstep;               // every loop step from 1 to this is checked
+        int nthreads;                   // threads for parallel engines (must be more than 1 to use them)
+        uint64_t seed;                  // seed for the synthetic scenes
+    };
+
+
+    // Result of one verification case.
+    class VerifyResult
+    {
+    public:
+        VerifyResult() : checksum(0), qmax(0.0), ptmax(0, 0) {}
+        virtual ~VerifyResult() {}
+    public:
+        std::string name;               // template, scene, angle step, and loop step
+        uint64_t checksum;              // checksum of every vote from the reference transform
+        double qmax;                    // highest reference vote
+        cv::Point ptmax;                // first location of highest reference vote
+        std::vector<std::string> mismatches;    // engines with any vote that differs from the reference and the first one
+    };
+
+
+    // Kinds of synthetic scene for verification.
+    enum
+    {
+        VERIFY_SCENE_TRANSLATED = 0,    // template placed at random location on plain background
+        VERIFY_SCENE_NOISY,             // same as translated with Gaussian noise
+        VERIFY_SCENE_CLUTTERED,         // template placed over random shapes
+        VERIFY_SCENE_OCCLUDED,          // same as translated with part of template covered
+        VERIFY_SCENE_COUNT,
+    };
+
+    // Returns name of synthetic scene type.
+    const char * get_verify_scene_name(const int n);
+
+    // Returns 64-bit FNV-1a checksum of the pixels of an image.
+    uint64_t get_image_checksum(const cv::Mat& rimg);
+
+    // Matches a gray template image in every kind of synthetic scene with every angle step and loop step.
+    // For each case the reference votes come from apply_ghough_transform_allpix and every voting engine,
+    // plus the FFT engine with a DFT for every key, the strip matcher, and the streaming matcher fed
+    // the scene in batches of rows, must match them exactly.
+    // The results are appended to a list.
+    void verify_template(
+        const std::string& rsname,
+        const cv::Mat& rimg,
+        const VerifySettings& rsettings,
+        std::vector<VerifyResult>& rvresults);
+
+    // Saves or loads the checksums and peaks of verification results (the "golden" results).
+    // Returns false if file cannot be written or read.
+    bool save_golden_results(const std::string& rsfile, const std::vector<VerifyResult>& rvresults);
+    bool load_golden_results(const std::string& rsfile, std::vector<VerifyResult>& rvresults);
+
+    // Compares verification results with golden results.
+    // A description of each case that is missing or has a different checksum or peak is appended to a list.
+    // Returns number of differences.
+    int compare_golden_results(
+        const std::vector<VerifyResult>& rvgolden,
+        const std::vector<VerifyResult>& rvresults,
+        std::vector<std::string>& rvdiffs);
+}
+
+#endif // VERIFIER_H_
@@ -0,0 +1,510 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <tuple>
+#include "VoteEngine.h"
+
+
+namespace ghalgo
+{
+    bool VoteEngine::Geometry::operator<(const Geometry& rother) const
+    {
+        return
+            std::tie(img_sz.width, img_sz.height, template_sz.width, template_sz.height, votes_log2, ijstep, nthreads, keys_log2) <
+            std::tie(rother.img_sz.width, rother.img_sz.height, rother.template_sz.width, rother.template_sz.height, rother.votes_log2, rother.ijstep, rother.nthreads, rother.keys_log2);
+    }
+
+
+    int VoteEngine::Geometry::get_log2_bucket(const size_t n)
+    {
+        int result = 0;
+        for (size_t x = n; x > 1; x >>= 1)
+        {
+            result++;
+        }
+        return result;
+    }
+
+
+    double VoteEngine::Geometry::get_max_votes(void) const
+    {
+        // middle of the bucket
+        return std::ldexp(1.5, votes_log2);
+    }
+
+
+    double VoteEngine::Geometry::get_key_count(void) const
+    {
+        return std::ldexp(1.5, keys_log2);
+    }
+
+
+    VoteEngine::Profile::Profile() :
+        best(AUTO),
+        last_used(0)
+    {
+        for (int n = 0; n < COUNT; ++n)
+        {
+            msec[n] = 0.0;
+            trials[n] = 0;
+        }
+    }
+
+
+    VoteEngine::VoteEngine() :
+        m_engine(AUTO),
+        m_nthreads(1),
+        m_is_logging_enabled(true),
+        m_frames(0),
+        m_dft_cost_scale(1.0)
+    {
+    }
+
+
+    VoteEngine::~VoteEngine()
+    {
+    }
+
+
+    void VoteEngine::set_thread_count(const int n)
+    {
+        m_nthreads = (n > 0) ? n : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        if (m_ppool && (m_ppool->get_worker_count() != m_nthreads))
+        {
+            m_ppool.reset();
+        }
+    }
+
+
+    size_t VoteEngine::memory_usage(void) const
+    {
+        size_t result = m_active.capacity() * sizeof(std::vector<cv::Point>);
+        for (const auto& r : m_active)
+        {
+            result += r.capacity() * sizeof(cv::Point);
+        }
+        for (const auto& r : m_partial)
+        {
+            result += get_mat_bytes(r);
+        }
+        result += m_sorted.memory_usage();
+        for (const auto& r : m_ranges)
+        {
+            result += r.capacity() * sizeof(std::pair<size_t, size_t>);
+        }
+        result += m_fft.memory_usage();
+        result += m_flat.memory_usage();
+        return result;
+    }
+
+
+    const char * VoteEngine::get_engine_name(const int n)
+    {
+        static const char * snames[COUNT] = { "auto", "scatter", "split", "sparse", "parallel", "banded", "fft", "fixed" };
+        return ((n >= 0) && (n < COUNT)) ? snames[n] : "unknown";
+    }
+
+
+    int VoteEngine::apply(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        const int ijstep)
+    {
+        int engine = m_engine;
+        if (engine == AUTO)
+        {
+            // time the engine if it is still being tuned
+            Geometry geom;
+            geom.img_sz = rkeyimg.size();
+            geom.template_sz = rtable.img_sz;
+            geom.votes_log2 = Geometry::get_log2_bucket(rtable.max_votes);
+            geom.ijstep = ijstep;
+            geom.nthreads = m_nthreads;
+            geom.keys_log2 = Geometry::get_log2_bucket(rtable.keys_used);
+            m_frames++;
+            engine = select(geom);
+            int64_t t0 = cv::getTickCount();
+            run(engine, rkeyimg, rvotes, rtable, ijstep);
+            int64_t t1 = cv::getTickCount();
+            record(geom, engine, (1000.0 * (t1 - t0)) / cv::getTickFrequency());
+        }
+        else
+        {
+            run(engine, rkeyimg, rvotes, rtable, ijstep);
+        }
+        return engine;
+    }
+
+
+    bool VoteEngine::load_profile(const std::string& rsfile)
+    {
+        bool result = false;
+        cv::FileStorage fs(rsfile, cv::FileStorage::READ);
+        if (fs.isOpened())
+        {
+            cv::FileNode node = fs["profiles"];
+            for (auto iter = node.begin(); iter != node.end(); ++iter)
+            {
+                Geometry geom;
+                int max_votes = 0;
+                int nthreads = 1;
+                int nkeys = 0;
+                std::string sengine;
+                (*iter)["img_sz"] >> geom.img_sz;
+                (*iter)["template_sz"] >> geom.template_sz;
+                (*iter)["max_votes"] >> max_votes;
+                (*iter)["ijstep"] >> geom.ijstep;
+                (*iter)["threads"] >> nthreads;
+                (*iter)["keys"] >> nkeys;
+                (*iter)["engine"] >> sengine;
+                geom.votes_log2 = Geometry::get_log2_bucket(static_cast<size_t>(std::max(0, max_votes)));
+                geom.nthreads = std::max(1, nthreads);
+                geom.keys_log2 = Geometry::get_log2_bucket(static_cast<size_t>(std::max(0, nkeys)));
+
+                // unknown engine names are ignored so the combination will be tuned again
+                for (int n = AUTO + 1; n < COUNT; ++n)
+                {
+                    if (sengine == get_engine_name(n))
+                    {
+                        get_profile(geom).best = n;
+                    }
+                }
+            }
+            result = true;
+        }
+        return result;
+    }
+
+
+    bool VoteEngine::save_profile(const std::string& rsfile) const
+    {
+        bool result = false;
+        cv::FileStorage fs(rsfile, cv::FileStorage::WRITE);
+        if (fs.isOpened())
+        {
+            fs << "profiles" << "[";
+            for (const auto& rpair : m_profiles)
+            {
+                if (rpair.second.best != AUTO)
+                {
+                    const Geometry& rgeom = rpair.first;
+                    fs << "{";
+                    fs << "img_sz" << rgeom.img_sz;
+                    fs << "template_sz" << rgeom.template_sz;
+                    // counts are saved as the lowest value in each bucket
+                    fs << "max_votes" << (1 << rgeom.votes_log2);
+                    fs << "ijstep" << rgeom.ijstep;
+                    fs << "threads" << rgeom.nthreads;
+                    fs << "keys" << (1 << rgeom.keys_log2);
+                    fs << "engine" << std::string(get_engine_name(rpair.second.best));
+                    fs << "}";
+                }
+            }
+            fs << "]";
+            result = true;
+        }
+        return result;
+    }
+
+
+    bool VoteEngine::is_usable(const Geometry& rgeom, const int engine) const
+    {
+        bool result = true;
+        if ((engine == PARALLEL) || (engine == BANDED))
+        {
+            // no point in timing parallel engines if there is only one thread
+            result = (rgeom.nthreads > 1);
+        }
+        else if (engine == FFT)
+        {
+            // FFT engine falls back to direct voting for any key where a DFT costs more
+            // so only try it if a key with a typical number of edge pixels and entries would use a DFT
+            // table offsets are assumed to span the template centered on the origin
+            const double ngrid = static_cast<double>(rgeom.img_sz.area()) / (rgeom.ijstep * rgeom.ijstep);
+            const double nkeys = rgeom.get_key_count();
+            const double key_votes = ((ngrid * EDGE_PERCENT) / (100.0 * nkeys)) * (rgeom.get_max_votes() / nkeys);
+            const cv::Rect ext(
+                -rgeom.template_sz.width / 2, -rgeom.template_sz.height / 2,
+                rgeom.template_sz.width, rgeom.template_sz.height);
+            result = (key_votes > (m_dft_cost_scale * get_dft_cost(get_ghough_dft_size(rgeom.img_sz, ext))));
+        }
+        return result;
+    }
+
+
+    int VoteEngine::select(const Geometry& rgeom)
+    {
+        // use fastest engine if tuning is done
+        // otherwise pick first engine that still needs more trials
+        int result = SCATTER;
+        const Profile& rprofile = get_profile(rgeom);
+        if (rprofile.best != AUTO)
+        {
+            result = rprofile.best;
+        }
+        else
+        {
+            for (int n = AUTO + 1; n < COUNT; ++n)
+            {
+                if (is_usable(rgeom, n) && (rprofile.trials[n] < TUNING_TRIALS))
+                {
+                    result = n;
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+
+
+    VoteEngine::Profile& VoteEngine::get_profile(const Geometry& rgeom)
+    {
+        auto iter = m_profiles.find(rgeom);
+        if (iter == m_profiles.end())
+        {
+            // make room by dropping the combination that has gone unused the longest
+            if (m_profiles.size() >= MAX_PROFILES)
+            {
+                auto iter_oldest = m_profiles.begin();
+                for (auto iter_old = m_profiles.begin(); iter_old != m_profiles.end(); ++iter_old)
+                {
+                    if (iter_old->second.last_used < iter_oldest->second.last_used)
+                    {
+                        iter_oldest = iter_old;
+                    }
+                }
+                m_profiles.erase(iter_oldest);
+            }
+            iter = m_profiles.insert(std::make_pair(rgeom, Profile())).first;
+        }
+        iter->second.last_used = m_frames;
+        return iter->second;
+    }
+
+
+    void VoteEngine::record(const Geometry& rgeom, const int engine, const double msec)
+    {
+        Profile& rprofile = get_profile(rgeom);
+        if (rprofile.best == AUTO)
+        {
+            // keep the best time for each engine since occasional frames may be slowed by other activity
+            if ((rprofile.trials[engine] == 0) || (msec < rprofile.msec[engine]))
+            {
+                rprofile.msec[engine] = msec;
+            }
+            rprofile.trials[engine]++;
+
+            // choose fastest engine once all of them have been timed
+            bool is_done = true;
+            for (int n = AUTO + 1; n < COUNT; ++n)
+            {
+                is_done = is_done && (!is_usable(rgeom, n) || (rprofile.trials[n] >= TUNING_TRIALS));
+            }
+
+            if (is_done)
+            {
+                rprofile.best = SCATTER;
+                for (int n = AUTO + 1; n < COUNT; ++n)
+                {
+                    if (is_usable(rgeom, n) && (rprofile.msec[n] < rprofile.msec[rprofile.best]))
+                    {
+                        rprofile.best = n;
+                    }
+                }
+
+                if (m_is_logging_enabled)
+                {
+                    std::cout << "ENGINE:  " << rgeom.img_sz.width << "x" << rgeom.img_sz.height;
+                    std::cout << ", template=" << rgeom.template_sz.width << "x" << rgeom.template_sz.height;
+                    std::cout << ", votes=" << (1 << rgeom.votes_log2) << "+, step=" << rgeom.ijstep;
+                    std::cout << ", threads=" << rgeom.nthreads;
+                    for (int n = AUTO + 1; n < COUNT; ++n)
+                    {
+                        if (is_usable(rgeom, n))
+                        {
+                            std::cout << ", " << get_engine_name(n) << "=";
+                            std::cout << std::fixed << std::setprecision(2) << rprofile.msec[n] << "ms";
+                        }
+                    }
+                    std::cout << " -> " << get_engine_name(rprofile.best) << std::endl;
+                }
+            }
+        }
+    }
+
+
+    void VoteEngine::run(
+        const int engine,
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        const int ijstep)
+    {
+        switch (engine)
+        {
+            case SPLIT:
+            {
+                apply_ghough_transform_split<uint8_t, CV_16U, uint16_t>(rkeyimg, rvotes, rtable, ijstep);
+                break;
+            }
+            case SPARSE:
+            {
+                apply_ghough_transform_sparse<uint8_t, CV_16U, uint16_t>(rkeyimg, rvotes, rtable, m_active, ijstep);
+                break;
+            }
+            case PARALLEL:
+            {
+                run_parallel(rkeyimg, rvotes, rtable, ijstep);
+                break;
+            }
+            case BANDED:
+            {
+                run_banded(rkeyimg, rvotes, rtable, ijstep);
+                break;
+            }
+            case FFT:
+            {
+                apply_ghough_transform_fft<uint8_t, CV_16U, uint16_t>(rkeyimg, rvotes, rtable, m_fft, ijstep, m_dft_cost_scale);
+                break;
+            }
+            case FIXED:
+            {
+                // use split engine for loop steps without a specialized kernel
+                T_FIXED_GHOUGH_KERNEL pfunc = get_fixed_ghough_kernel<uint8_t, CV_16U, uint16_t>(ijstep);
+                if (pfunc)
+                {
+                    pfunc(rkeyimg, rvotes, rtable, m_flat);
+                }
+                else
+                {
+                    apply_ghough_transform_split<uint8_t, CV_16U, uint16_t>(rkeyimg, rvotes, rtable, ijstep);
+                }
+                break;
+            }
+            case SCATTER:
+            default:
+            {
+                apply_ghough_transform_allpix<uint8_t, CV_16U, uint16_t>(rkeyimg, rvotes, rtable, ijstep);
+                break;
+            }
+        }
+    }
+
+
+    void VoteEngine::run_parallel(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        const int ijstep)
+    {
+        if (!m_ppool)
+        {
+            m_ppool.reset(new WorkStealingPool(m_nthreads));
+        }
+
+        // each worker votes into its own image so no locks or atomic adds are needed
+        const int nworkers = m_ppool->get_worker_count();
+        m_partial.resize(nworkers);
+        for (auto& rimg : m_partial)
+        {
+            rimg.create(rkeyimg.size(), CV_16U);
+        }
+        m_ppool->run(nworkers, [this](size_t task, int)
+        {
+            m_partial[task].setTo(0);
+        });
+
+        // input rows are dealt out in small chunks and idle workers steal chunks from busy ones
+        // so a band with lots of edges does not hold up the whole frame
+        const int rows_per_task = ROWS_PER_TASK * ijstep;
+        const size_t ntasks = static_cast<size_t>(std::max(0, rkeyimg.rows - 2) + rows_per_task - 1) / rows_per_task;
+        m_ppool->run(ntasks, [&](size_t task, int nworker)
+        {
+            const int ibegin = 1 + static_cast<int>(task) * rows_per_task;
+            add_ghough_votes_for_rows<uint8_t, uint16_t>(
+                rkeyimg, m_partial[nworker], rtable, ibegin, ibegin + rows_per_task, ijstep);
+        });
+
+        // sum the worker images in bands of output rows
+        // plain integer adds so the result matches the other engines exactly
+        rvotes = cv::Mat(rkeyimg.size(), CV_16U);
+        const size_t nbands = static_cast<size_t>(rvotes.rows + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+        m_ppool->run(nbands, [&](size_t band, int)
+        {
+            const int ibegin = static_cast<int>(band) * ROWS_PER_TASK;
+            const int iend = std::min(ibegin + ROWS_PER_TASK, rvotes.rows);
+            for (int i = ibegin; i < iend; ++i)
+            {
+                uint16_t * pdst = rvotes.ptr<uint16_t>(i);
+                const uint16_t * psrc = m_partial[0].ptr<uint16_t>(i);
+                std::copy(psrc, psrc + rvotes.cols, pdst);
+                for (int n = 1; n < nworkers; ++n)
+                {
+                    psrc = m_partial[n].ptr<uint16_t>(i);
+                    for (int j = 0; j < rvotes.cols; ++j)
+                    {
+                        pdst[j] = static_cast<uint16_t>(pdst[j] + psrc[j]);
+                    }
+                }
+            }
+        });
+    }
+
+
+    void VoteEngine::run_banded(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        const int ijstep)
+    {
+        if (!m_ppool)
+        {
+            m_ppool.reset(new WorkStealingPool(m_nthreads));
+        }
+
+        // each task owns a band of output rows and is the only writer to that band
+        // so there are no atomic adds, no per-thread vote images, and no merge
+        // there are a few bands per thread so busy bands can be balanced by stealing
+        // the sorted copy keeps the generation of the table so it is only re-sorted when the table changes
+        rvotes = cv::Mat::zeros(rkeyimg.size(), CV_16U);
+        if (m_sorted.generation != rtable.generation)
+        {
+            sort_lookup_table_rows(rtable, m_sorted);
+        }
+        m_ranges.resize(m_ppool->get_worker_count());
+        const int nbands = m_ppool->get_worker_count() * BANDS_PER_THREAD;
+        const int band_rows = std::max(1, (rvotes.rows + nbands - 1) / nbands);
+        const size_t ntasks = static_cast<size_t>(rvotes.rows + band_rows - 1) / band_rows;
+        m_ppool->run(ntasks, [&](size_t task, int nworker)
+        {
+            const int obegin = static_cast<int>(task) * band_rows;
+            const int oend = std::min(obegin + band_rows, rvotes.rows);
+            add_ghough_votes_to_band<uint8_t, uint16_t>(
+                rkeyimg, rvotes, m_sorted, obegin, oend, m_ranges[nworker], ijstep);
+        });
+    }
+}
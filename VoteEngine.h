@@ -0,0 +1,193 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef VOTE_ENGINE_H_
+#define VOTE_ENGINE_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include "ghbase.h"
+#include "WorkStealingPool.h"
+
+
+namespace ghalgo
+{
+    // Selects and runs one of several Generalized Hough voting engines.
+    // All engines produce exactly the same votes as apply_ghough_transform_allpix.
+    // In automatic mode each engine is timed on the first few frames for a combination of
+    // template, image size, and loop step.  Then the fastest engine is used for that combination.
+    // The timings can be saved to a profile file and loaded later to skip the tuning.
+    // Each matcher context has its own engine so no locks are needed.
+    // The parallel engines are only used if the engine is given more than one thread.
+    // The FFT engine is only tried if a rough cost model says the table is big enough for it to pay off.
+    class VoteEngine
+    {
+    public:
+
+        enum
+        {
+            AUTO = 0,
+            SCATTER,
+            SPLIT,
+            SPARSE,
+            PARALLEL,
+            BANDED,
+            FFT,
+            FIXED,
+            COUNT,
+        };
+
+        VoteEngine();
+        virtual ~VoteEngine();
+
+        // Applies Generalized Hough transform to an 8-bit key image with 16-bit votes.
+        // Returns the engine that was used.
+        int apply(
+            const cv::Mat& rkeyimg,
+            cv::Mat& rvotes,
+            const ghalgo::LookupTable& rtable,
+            const int ijstep = 1);
+
+        // Sets engine to use for every frame.  AUTO selects the fastest engine automatically.
+        void set_engine(const int n) { m_engine = n; }
+        int get_engine(void) const { return m_engine; }
+
+        // Sets number of threads for parallel engine (0 for one per hardware thread).
+        void set_thread_count(const int n);
+        int get_thread_count(void) const { return m_nthreads; }
+
+        // Scales the cost of a DFT in the FFT engine's choice between a DFT and direct voting for each key.
+        // A scale of 0 makes it use a DFT for every key so that path can be verified on small images.
+        void set_dft_cost_scale(const double x) { m_dft_cost_scale = x; }
+        double get_dft_cost_scale(void) const { return m_dft_cost_scale; }
+
+        // Enables printing of tuning results
+        void set_logging_enabled(const bool x) { m_is_logging_enabled = x; }
+
+        static const char * get_engine_name(const int n);
+
+        // Returns approximate number of bytes allocated for scratch space by all of the engines.
+        size_t memory_usage(void) const;
+
+        // Loads or saves the fastest engine for each combination that has been tuned.
+        // Returns false if file cannot be read or written.
+        bool load_profile(const std::string& rsfile);
+        bool save_profile(const std::string& rsfile) const;
+        void clear_profile(void) { m_profiles.clear(); }
+
+    private:
+
+        // Number of frames each engine is timed before choosing
+        static const int TUNING_TRIALS = 3;
+
+        // Rows on the loop step grid in each task of the parallel engine
+        // Tasks are small so busy parts of the image can be shared among threads
+        static const int ROWS_PER_TASK = 4;
+
+        // Output bands for each thread in the banded engine
+        static const int BANDS_PER_THREAD = 4;
+
+        // Typical percentage of pixels with edges for FFT engine cost model
+        static const int EDGE_PERCENT = 25;
+
+        // Most combinations kept at once (least recently used ones are dropped)
+        // Templates that change every frame would otherwise add a combination every frame
+        static const size_t MAX_PROFILES = 64;
+
+        // The vote and key counts are rounded down to powers of 2 so templates that are rebuilt
+        // with slightly different edges (for example every frame in feedback mode) share a combination
+        class Geometry
+        {
+        public:
+            bool operator<(const Geometry& rother) const;
+            static int get_log2_bucket(const size_t n);
+            double get_max_votes(void) const;
+            double get_key_count(void) const;
+        public:
+            cv::Size img_sz;
+            cv::Size template_sz;
+            int votes_log2;
+            int ijstep;
+            int nthreads;
+            int keys_log2;
+        };
+
+        class Profile
+        {
+        public:
+            Profile();
+        public:
+            double msec[COUNT];
+            int trials[COUNT];
+            int best;
+            uint64_t last_used;
+        };
+
+        bool is_usable(const Geometry& rgeom, const int engine) const;
+        Profile& get_profile(const Geometry& rgeom);
+        int select(const Geometry& rgeom);
+        void record(const Geometry& rgeom, const int engine, const double msec);
+        void run(
+            const int engine,
+            const cv::Mat& rkeyimg,
+            cv::Mat& rvotes,
+            const ghalgo::LookupTable& rtable,
+            const int ijstep);
+        void run_parallel(
+            const cv::Mat& rkeyimg,
+            cv::Mat& rvotes,
+            const ghalgo::LookupTable& rtable,
+            const int ijstep);
+        void run_banded(
+            const cv::Mat& rkeyimg,
+            cv::Mat& rvotes,
+            const ghalgo::LookupTable& rtable,
+            const int ijstep);
+
+        int m_engine;
+        int m_nthreads;
+        bool m_is_logging_enabled;
+        std::map<Geometry, Profile> m_profiles;
+        uint64_t m_frames;
+
+        // Scratch space for sparse engine
+        std::vector<std::vector<cv::Point>> m_active;
+
+        // Thread pool and vote image for each worker for parallel engine
+        std::unique_ptr<WorkStealingPool> m_ppool;
+        std::vector<cv::Mat> m_partial;
+
+        // Sorted copy of table and entry ranges for each worker for banded engine
+        ghalgo::LookupTable m_sorted;
+        std::vector<std::vector<std::pair<size_t, size_t>>> m_ranges;
+
+        // Table spectra and buffers for FFT engine
+        ghalgo::FftVoteScratch m_fft;
+        double m_dft_cost_scale;
+
+        // Flattened table for kernels specialized for each loop step
+        ghalgo::FlatLookupTable m_flat;
+    };
+}
+
+#endif // VOTE_ENGINE_H_
@@ -0,0 +1,168 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include "WorkStealingPool.h"
+
+
+namespace ghalgo
+{
+    WorkStealingPool::WorkStealingPool(const int nworkers) :
+        m_nworkers(nworkers),
+        m_pfunc(nullptr),
+        m_batch(0),
+        m_nbusy(0),
+        m_is_stopping(false)
+    {
+        if (m_nworkers <= 0)
+        {
+            m_nworkers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        }
+
+        for (int n = 0; n < m_nworkers; ++n)
+        {
+            m_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+        }
+
+        // worker 0 is the thread that calls run
+        for (int n = 1; n < m_nworkers; ++n)
+        {
+            m_threads.push_back(std::thread(&WorkStealingPool::thread_main, this, n));
+        }
+    }
+
+
+    WorkStealingPool::~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_is_stopping = true;
+        }
+        m_cv_start.notify_all();
+        for (auto& rthread : m_threads)
+        {
+            rthread.join();
+        }
+    }
+
+
+    void WorkStealingPool::run(const size_t ntasks, const std::function<void(size_t, int)>& rfunc)
+    {
+        // deal out contiguous blocks of tasks
+        // neighboring tasks usually touch neighboring memory so this is kinder to the cache than round-robin
+        size_t task = 0;
+        for (int n = 0; n < m_nworkers; ++n)
+        {
+            const size_t task_end = (ntasks * (n + 1)) / m_nworkers;
+            std::lock_guard<std::mutex> lock(m_queues[n]->mutex);
+            for (; task < task_end; ++task)
+            {
+                m_queues[n]->tasks.push_back(task);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pfunc = &rfunc;
+            m_nbusy = m_nworkers - 1;
+            m_batch++;
+        }
+        m_cv_start.notify_all();
+
+        do_tasks(0);
+
+        // wait for other workers to finish their last task
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv_done.wait(lock, [this] { return m_nbusy == 0; });
+        m_pfunc = nullptr;
+    }
+
+
+    void WorkStealingPool::thread_main(const int nworker)
+    {
+        size_t batch = 0;
+        bool is_running = true;
+        while (is_running)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv_start.wait(lock, [this, batch] { return m_is_stopping || (m_batch != batch); });
+                is_running = !m_is_stopping;
+                batch = m_batch;
+            }
+
+            if (is_running)
+            {
+                do_tasks(nworker);
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_nbusy--;
+                }
+                m_cv_done.notify_one();
+            }
+        }
+    }
+
+
+    void WorkStealingPool::do_tasks(const int nworker)
+    {
+        size_t task;
+        while (get_task(nworker, task))
+        {
+            (*m_pfunc)(task, nworker);
+        }
+    }
+
+
+    bool WorkStealingPool::get_task(const int nworker, size_t& rtask)
+    {
+        bool result = false;
+
+        // take from front of own queue
+        {
+            WorkerQueue& rqueue = *m_queues[nworker];
+            std::lock_guard<std::mutex> lock(rqueue.mutex);
+            if (!rqueue.tasks.empty())
+            {
+                rtask = rqueue.tasks.front();
+                rqueue.tasks.pop_front();
+                result = true;
+            }
+        }
+
+        // otherwise steal from back of another queue
+        // tasks are only added at start of batch so if every queue is empty the batch is done for this worker
+        for (int k = 1; !result && (k < m_nworkers); ++k)
+        {
+            WorkerQueue& rqueue = *m_queues[(nworker + k) % m_nworkers];
+            std::lock_guard<std::mutex> lock(rqueue.mutex);
+            if (!rqueue.tasks.empty())
+            {
+                rtask = rqueue.tasks.back();
+                rqueue.tasks.pop_back();
+                result = true;
+            }
+        }
+
+        return result;
+    }
+}
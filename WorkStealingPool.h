@@ -0,0 +1,85 @@
+// MIT License
+//
+// Copyright(c) 2020 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef WORK_STEALING_POOL_H_
+#define WORK_STEALING_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace ghalgo
+{
+    // Pool of threads that run a batch of numbered tasks.
+    // Each worker starts with its own queue holding a contiguous block of tasks.
+    // A worker that runs out of tasks steals from the back of another worker's queue
+    // so a few slow tasks do not leave the other workers idle.
+    // The thread that calls run is also a worker so the pool has one less thread than workers.
+    class WorkStealingPool
+    {
+    public:
+
+        // Creates pool with a number of workers (0 for one per hardware thread)
+        WorkStealingPool(const int nworkers = 0);
+        virtual ~WorkStealingPool();
+
+        // Runs tasks 0 to ntasks-1 and waits until they are all finished.
+        // The function is passed the task number and the number of the worker that runs it (0 to workers-1).
+        // Tasks run by the same worker never overlap so they can share per-worker scratch data.
+        void run(const size_t ntasks, const std::function<void(size_t, int)>& rfunc);
+
+        int get_worker_count(void) const { return m_nworkers; }
+
+    private:
+
+        class WorkerQueue
+        {
+        public:
+            std::mutex mutex;
+            std::deque<size_t> tasks;
+        };
+
+        void thread_main(const int nworker);
+        void do_tasks(const int nworker);
+        bool get_task(const int nworker, size_t& rtask);
+
+        int m_nworkers;
+        std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+        std::vector<std::thread> m_threads;
+
+        // state for current batch
+        std::mutex m_mutex;
+        std::condition_variable m_cv_start;
+        std::condition_variable m_cv_done;
+        const std::function<void(size_t, int)> * m_pfunc;
+        size_t m_batch;
+        int m_nbusy;
+        bool m_is_stopping;
+    };
+}
+
+#endif // WORK_STEALING_POOL_H_
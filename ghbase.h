@@ -23,11 +23,35 @@
 #ifndef GHBASE_H_
 #define GHBASE_H_
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <map>
 #include <vector>
 #include "opencv2/imgproc.hpp"
 
 namespace ghalgo
 {
+    // Returns number of bytes in the pixels of an image (0 if empty).
+    inline size_t get_mat_bytes(const cv::Mat& rimg)
+    {
+        return rimg.total() * rimg.elemSize();
+    }
+
+
+    // Returns a new table generation number.  Generation 0 is never returned
+    // so it can be used to mark a cache that has not been filled yet.
+    inline uint64_t get_next_table_generation()
+    {
+        static std::atomic<uint64_t> next_generation(0);
+        return ++next_generation;
+    }
+
+
     class LookupTable
     {
     public:
@@ -38,16 +62,135 @@ namespace ghalgo
             max_votes = 0;
             img_sz = cv::Size(0, 0);
             elems.clear();
+            extents = cv::Rect();
+            key_extents.clear();
+            key_row_hist.clear();
+            keys_used = 0;
+            generation = get_next_table_generation();
+        }
+        // Returns approximate number of bytes allocated for the table entries and metadata.
+        size_t memory_usage() const
+        {
+            size_t result = elems.capacity() * sizeof(std::vector<cv::Point>);
+            for (const auto& r : elems)
+            {
+                result += r.capacity() * sizeof(cv::Point);
+            }
+            result += key_extents.capacity() * sizeof(cv::Rect);
+            result += key_row_hist.capacity() * sizeof(std::vector<int>);
+            for (const auto& r : key_row_hist)
+            {
+                result += r.capacity() * sizeof(int);
+            }
+            return result;
+        }
+        // Returns upper bound for memory_usage of a table with a given number of entries and keys
+        // that is made from a key image with a given number of rows.
+        static size_t estimate_memory_usage(const size_t nentries, const size_t nkeys, const int rows)
+        {
+            // the row histograms are never taller than the key image (plus one for the total)
+            const size_t key_bytes =
+                sizeof(std::vector<cv::Point>) + sizeof(cv::Rect) + sizeof(std::vector<int>) + (rows + 1) * sizeof(int);
+            return (nkeys * key_bytes) + (nentries * sizeof(cv::Point));
+        }
+        // Releases any space reserved for entries that was not used.
+        void shrink_to_fit()
+        {
+            for (auto& r : elems)
+            {
+                std::vector<cv::Point>(r).swap(r);
+            }
+        }
+        // Fills in vote count and metadata from the table entries.
+        // This must be called whenever the entries are changed.
+        // A new generation is assigned so anything derived from the old entries gets rebuilt.
+        void update_metadata()
+        {
+            generation = get_next_table_generation();
+            int xmin = INT_MAX;
+            int ymin = INT_MAX;
+            int xmax = INT_MIN;
+            int ymax = INT_MIN;
+            max_votes = 0;
+            keys_used = 0;
+            key_extents.assign(elems.size(), cv::Rect());
+            for (size_t ii = 0; ii < elems.size(); ++ii)
+            {
+                if (elems[ii].size())
+                {
+                    int kxmin = INT_MAX;
+                    int kymin = INT_MAX;
+                    int kxmax = INT_MIN;
+                    int kymax = INT_MIN;
+                    for (const auto& rpt : elems[ii])
+                    {
+                        kxmin = std::min(kxmin, rpt.x);
+                        kymin = std::min(kymin, rpt.y);
+                        kxmax = std::max(kxmax, rpt.x);
+                        kymax = std::max(kymax, rpt.y);
+                    }
+                    key_extents[ii] = cv::Rect(kxmin, kymin, kxmax - kxmin + 1, kymax - kymin + 1);
+                    xmin = std::min(xmin, kxmin);
+                    ymin = std::min(ymin, kymin);
+                    xmax = std::max(xmax, kxmax);
+                    ymax = std::max(ymax, kymax);
+                    max_votes += elems[ii].size();
+                    keys_used++;
+                }
+            }
+            extents = (max_votes) ? cv::Rect(xmin, ymin, xmax - xmin + 1, ymax - ymin + 1) : cv::Rect();
+
+            // cumulative histogram bins are row offsets from top of extents
+            // (keys with no entries have no bins)
+            key_row_hist.assign(elems.size(), std::vector<int>());
+            for (size_t ii = 0; ii < elems.size(); ++ii)
+            {
+                if (elems[ii].size())
+                {
+                    std::vector<int>& rhist = key_row_hist[ii];
+                    rhist.assign(extents.height + 1, 0);
+                    for (const auto& rpt : elems[ii])
+                    {
+                        rhist[rpt.y - extents.y + 1]++;
+                    }
+                    for (size_t r = 1; r < rhist.size(); ++r)
+                    {
+                        rhist[r] += rhist[r - 1];
+                    }
+                }
+            }
+        }
+        // Returns number of entries for a key with row offsets below extents.y + r.
+        // The key must have entries and r is clamped to the extents so r <= 0 gives 0
+        // and r >= extents.height gives the number of entries for the key (same as elems[key].size()).
+        int get_key_rows_below(const size_t key, const int r) const
+        {
+            return key_row_hist[key][std::min(std::max(r, 0), extents.height)];
         }
     public:
         size_t max_votes;
         cv::Size img_sz;
         std::vector< std::vector<cv::Point> > elems;
+
+        // metadata from update_metadata
+        cv::Rect extents;                               // bounding box of all offsets (empty if no entries)
+        std::vector<cv::Rect> key_extents;              // bounding box of offsets for each key
+        std::vector<std::vector<int>> key_row_hist;     // entries for each key with row offset below extents.y + bin
+        size_t keys_used;                               // number of keys with entries
+        uint64_t generation;                            // changes when entries change, copies share it
     };
 
     
+    // Creates Generalized Hough table from an encoded "key" image.
+    // An optional minimum distance will spread out the template edge points (Poisson-disk style).
+    // Points are visited in raster order and a point is skipped if it is closer than the minimum
+    // distance to a point that was already kept.  A distance of 1 or less keeps every point.
     template<typename T_KEY>
-    void create_lookup_table(const cv::Mat& rkey, const T_KEY max_key, ghalgo::LookupTable& rtable)
+    void create_lookup_table(
+        const cv::Mat& rkey,
+        const T_KEY max_key,
+        ghalgo::LookupTable& rtable,
+        const double min_dist = 0.0)
     {
         // calculate centering offset
         int row_offset = rkey.rows / 2;
@@ -56,15 +199,40 @@ namespace ghalgo
         // the size of the table is max_key + 1 since it contains keys 0 to max_key
         size_t iimax = max_key + 1;
 
+        // count the pixels with each key so exactly enough space can be reserved
+        // (it is an upper bound if points are spread out)
+        std::vector<size_t> counts(iimax, 0);
+        for (int i = 0; i < rkey.rows; ++i)
+        {
+            const T_KEY * pix = rkey.ptr<T_KEY>(i);
+            for (int j = 0; j < rkey.cols; ++j)
+            {
+                if (pix[j] < iimax)
+                {
+                    counts[pix[j]]++;
+                }
+            }
+        }
+
         // blow away old table
         // reserve space for table entries except for key 0 which is unused
         rtable.clear();
         rtable.elems.resize(iimax);
         for (size_t ii = 1; ii < iimax; ++ii)
         {
-            rtable.elems[ii].reserve(2048);
+            rtable.elems[ii].reserve(counts[ii]);
         }
 
+        // set up acceleration grid for minimum distance check
+        // cell diagonal is the minimum distance so each cell holds at most one kept point
+        // and any point closer than minimum distance is at most 2 cells away
+        const bool is_spaced = (min_dist > 1.0);
+        const double min_dist_sq = min_dist * min_dist;
+        const double cell = min_dist / std::sqrt(2.0);
+        const int grid_cols = (is_spaced) ? static_cast<int>(rkey.cols / cell) + 1 : 0;
+        const int grid_rows = (is_spaced) ? static_cast<int>(rkey.rows / cell) + 1 : 0;
+        std::vector<cv::Point> grid(grid_cols * grid_rows, cv::Point(-1, -1));
+
         // iterate through the key image pixel-by-pixel
         rtable.img_sz = rkey.size();
         for (int i = 0; i < rkey.rows; ++i)
@@ -76,14 +244,231 @@ namespace ghalgo
                 const T_KEY ghkey = pix[j];
                 if (ghkey)
                 {
+                    if (is_spaced)
+                    {
+                        // skip point if it is too close to a point that was already kept
+                        bool is_too_close = false;
+                        const int gx = static_cast<int>(j / cell);
+                        const int gy = static_cast<int>(i / cell);
+                        for (int gi = std::max(0, gy - 2); (gi <= std::min(grid_rows - 1, gy + 2)) && !is_too_close; ++gi)
+                        {
+                            for (int gj = std::max(0, gx - 2); gj <= std::min(grid_cols - 1, gx + 2); ++gj)
+                            {
+                                const cv::Point& rpt = grid[gi * grid_cols + gj];
+                                const double dx = rpt.x - j;
+                                const double dy = rpt.y - i;
+                                if ((rpt.x >= 0) && ((dx * dx + dy * dy) < min_dist_sq))
+                                {
+                                    is_too_close = true;
+                                    break;
+                                }
+                            }
+                        }
+
+                        if (is_too_close)
+                        {
+                            continue;
+                        }
+                        grid[gy * grid_cols + gx] = cv::Point(j, i);
+                    }
+
                     // the vote count is mapped to a point and incremented
                     // max possible votes is number of non-zero keys
                     cv::Point offset_pt = cv::Point(col_offset - j, row_offset - i);
                     rtable.elems[ghkey].push_back(offset_pt);
-                    rtable.max_votes++;
                 }
             }
         }
+
+        if (is_spaced)
+        {
+            rtable.shrink_to_fit();
+        }
+        rtable.update_metadata();
+    }
+
+
+    // Creates Generalized Hough table from an encoded "key" image with the number of template edge points
+    // reduced by roughly the given factor (2 keeps about 1/2, 4 keeps about 1/4, etc.).
+    // The points are spread evenly over the template.  It searches for the smallest minimum distance
+    // between kept points that gets to the target count.  This composes with skipping rows and columns
+    // in the input image.
+    template<typename T_KEY>
+    void create_lookup_table_subsampled(
+        const cv::Mat& rkey,
+        const T_KEY max_key,
+        ghalgo::LookupTable& rtable,
+        const double factor)
+    {
+        create_lookup_table(rkey, max_key, rtable);
+        if (factor > 1.0)
+        {
+            // the distance will never need to be bigger than the template
+            const size_t target = static_cast<size_t>(rtable.max_votes / factor);
+            double lo = 1.0;
+            double hi = static_cast<double>(std::max(rkey.cols, rkey.rows));
+            for (int n = 0; n < 16; ++n)
+            {
+                double mid = 0.5 * (lo + hi);
+                create_lookup_table(rkey, max_key, rtable, mid);
+                if (rtable.max_votes <= target)
+                {
+                    hi = mid;
+                }
+                else
+                {
+                    lo = mid;
+                }
+            }
+            create_lookup_table(rkey, max_key, rtable, hi);
+        }
+    }
+
+
+    // Clusters points on a square grid and keeps one point per occupied grid cell.
+    // The point that is kept is the one closest to the mean of the points in its cell.
+    // Output points are ordered by grid row then grid column.
+    inline void cluster_lookup_points(const std::vector<cv::Point>& rsrc, const int cell, std::vector<cv::Point>& rdst)
+    {
+        std::map<std::pair<int, int>, std::vector<cv::Point>> cells;
+        rdst.clear();
+        if (rsrc.size())
+        {
+            // grid starts at the minimum point so cell indices are never negative
+            cv::Point ptmin = rsrc[0];
+            for (const auto& rpt : rsrc)
+            {
+                ptmin.x = std::min(ptmin.x, rpt.x);
+                ptmin.y = std::min(ptmin.y, rpt.y);
+            }
+
+            for (const auto& rpt : rsrc)
+            {
+                cells[std::make_pair((rpt.y - ptmin.y) / cell, (rpt.x - ptmin.x) / cell)].push_back(rpt);
+            }
+
+            for (const auto& rpair : cells)
+            {
+                const std::vector<cv::Point>& rvec = rpair.second;
+                double xmean = 0.0;
+                double ymean = 0.0;
+                for (const auto& rpt : rvec)
+                {
+                    xmean += rpt.x;
+                    ymean += rpt.y;
+                }
+                xmean /= rvec.size();
+                ymean /= rvec.size();
+
+                double dmin = 0.0;
+                size_t nbest = 0;
+                for (size_t k = 0; k < rvec.size(); ++k)
+                {
+                    const double dx = rvec[k].x - xmean;
+                    const double dy = rvec[k].y - ymean;
+                    const double d = dx * dx + dy * dy;
+                    if ((k == 0) || (d < dmin))
+                    {
+                        dmin = d;
+                        nbest = k;
+                    }
+                }
+                rdst.push_back(rvec[nbest]);
+            }
+        }
+    }
+
+
+    // Creates a smaller table that keeps roughly a given ratio (0 to 1) of the entries for each key.
+    // Neighboring entries for a key are mostly redundant so they are clustered on a grid.
+    // For each key the smallest grid cell size that gets to the target count (or below) is used.
+    // Every key with entries keeps at least one entry unless its ratio is 0 which drops the key.
+    inline void prune_lookup_table_keys(const ghalgo::LookupTable& rsrc, ghalgo::LookupTable& rdst, const std::vector<double>& rvratio)
+    {
+        rdst.clear();
+        rdst.img_sz = rsrc.img_sz;
+        rdst.elems.resize(rsrc.elems.size());
+        for (size_t ii = 0; ii < rsrc.elems.size(); ++ii)
+        {
+            const std::vector<cv::Point>& rvec = rsrc.elems[ii];
+            const double ratio = (ii < rvratio.size()) ? rvratio[ii] : 1.0;
+            const size_t target = std::max<size_t>(1, static_cast<size_t>(std::round(ratio * rvec.size())));
+            if ((ratio > 0.0) && (rvec.size() <= target))
+            {
+                rdst.elems[ii] = rvec;
+            }
+            else if (ratio > 0.0)
+            {
+                // binary search for cell size
+                // a cell of 1 keeps everything and a cell bigger than the template keeps one point
+                std::vector<cv::Point> vtemp;
+                int lo = 1;
+                int hi = std::max(rsrc.img_sz.width, rsrc.img_sz.height) + 1;
+                while ((hi - lo) > 1)
+                {
+                    int mid = (lo + hi) / 2;
+                    cluster_lookup_points(rvec, mid, vtemp);
+                    if (vtemp.size() <= target)
+                    {
+                        hi = mid;
+                    }
+                    else
+                    {
+                        lo = mid;
+                    }
+                }
+                cluster_lookup_points(rvec, hi, rdst.elems[ii]);
+            }
+        }
+        rdst.update_metadata();
+    }
+
+
+    // Creates a smaller table that keeps roughly the given ratio (0 to 1) of the entries for every key.
+    inline void prune_lookup_table(const ghalgo::LookupTable& rsrc, ghalgo::LookupTable& rdst, const double ratio)
+    {
+        prune_lookup_table_keys(rsrc, rdst, std::vector<double>(rsrc.elems.size(), ratio));
+    }
+
+
+    // Adds the number of pixels with each key in an encoded "key" image to a histogram.
+    // Keys past the end of the histogram are ignored.
+    template<typename T_KEY>
+    void add_key_histogram(const cv::Mat& rkey, std::vector<double>& rhist)
+    {
+        for (int i = 0; i < rkey.rows; ++i)
+        {
+            const T_KEY * pix = rkey.ptr<T_KEY>(i);
+            for (int j = 0; j < rkey.cols; ++j)
+            {
+                if (pix[j] < rhist.size())
+                {
+                    rhist[pix[j]] += 1.0;
+                }
+            }
+        }
+    }
+
+
+    // Copies table with the entries for each key sorted by row offset then column offset.
+    // Voting order does not change the results so the sorted table can be used in place of the original.
+    inline void sort_lookup_table_rows(const ghalgo::LookupTable& rsrc, ghalgo::LookupTable& rdst)
+    {
+        rdst = rsrc;
+        for (auto& rvec : rdst.elems)
+        {
+            std::sort(rvec.begin(), rvec.end(), [](const cv::Point& a, const cv::Point& b)
+            {
+                return (a.y < b.y) || ((a.y == b.y) && (a.x < b.x));
+            });
+        }
+    }
+
+
+    // Returns first value on grid (start + n * step) that is at or above a minimum value.
+    inline int get_first_on_grid(const int start, const int step, const int minval)
+    {
+        return (minval <= start) ? start : start + ((minval - start + step - 1) / step) * step;
     }
 
 
@@ -92,8 +477,10 @@ namespace ghalgo
     // Template parameters specify key type and output image type.  Examples:
     // - uint8_t key and votes are float:       <uint8_t,CV_32F,float>
     // - uint16_t key and votes are uint16_t:   <uint16_t,CV_16U,uint16_t>
-    // The size of the target image used to generate the table will constrain the results.
-    // Pixels near border and within half the X or Y dimensions of target image will be 0.
+    // The extents of the table entries will constrain the results.
+    // Only pixels where every vote lands inside the image are processed so no votes are range-checked.
+    // Pixels near border and within the extents of the table will not vote.
+    // The pixels on the step grid start at half the template size like they always have.
     // Output image is same size as input.  Maxima indicate good matches.
     template<typename T_KEY, int E_VOTE_IMG_TYPE, typename T_VOTE>
     void apply_ghough_transform(
@@ -103,10 +490,15 @@ namespace ghalgo
         const int ijstep = 1)
     {
         rvotes = cv::Mat::zeros(rkeyimg.size(), E_VOTE_IMG_TYPE);
-        for (int i = rtable.img_sz.height / 2; i < rkeyimg.rows - rtable.img_sz.height / 2; i += ijstep)
+        const cv::Rect& rext = rtable.extents;
+        const int ibegin = get_first_on_grid(rtable.img_sz.height / 2, ijstep, std::max(0, -rext.y));
+        const int iend = rkeyimg.rows - std::max(0, rext.y + rext.height - 1);
+        const int jbegin = get_first_on_grid(rtable.img_sz.width / 2, ijstep, std::max(0, -rext.x));
+        const int jend = rkeyimg.cols - std::max(0, rext.x + rext.width - 1);
+        for (int i = ibegin; i < iend; i += ijstep)
         {
             const T_KEY * pix = rkeyimg.ptr<T_KEY>(i);
-            for (int j = rtable.img_sz.width / 2; j < rkeyimg.cols - rtable.img_sz.width / 2; j += ijstep)
+            for (int j = jbegin; j < jend; j += ijstep)
             {
                 // look up voting table for key
                 // iterate through the points (if any) and add votes
@@ -167,6 +559,740 @@ namespace ghalgo
             }
         }
     }
+
+
+    // Returns number of votes an encoded "key" image casts with a lookup table, including votes
+    // that fall outside the output image.  Rows and columns are visited the same way as allpix.
+    template<typename T_KEY>
+    uint64_t count_ghough_votes(
+        const cv::Mat& rkeyimg,
+        const ghalgo::LookupTable& rtable,
+        const int ijstep = 1)
+    {
+        uint64_t result = 0;
+        for (int i = 1; i < (rkeyimg.rows - 1); i += ijstep)
+        {
+            const T_KEY * pix = rkeyimg.ptr<T_KEY>(i);
+            for (int j = 1; j < (rkeyimg.cols - 1); j += ijstep)
+            {
+                result += rtable.elems[pix[j]].size();
+            }
+        }
+        return result;
+    }
+
+
+    // Applies Generalized Hough transform to a "key" image that has half the resolution of the table.
+    // Key pixel (i, j) is treated as full resolution pixel (2i, 2j) so the table offsets are used as-is.
+    // Votes go to a full resolution image of the given size, or to an image the size of the key image
+    // where each vote lands in the half resolution pixel that contains the full resolution vote.
+    // Rows and columns of the key image are visited the same way as allpix.
+    // Each vote is range-checked.  Votes that would fall outside the image are discarded.
+    template<typename T_KEY, int E_VOTE_IMG_TYPE, typename T_VOTE>
+    void apply_ghough_transform_half(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        const cv::Size& rfull_sz,
+        const bool is_half_votes,
+        const int ijstep = 1)
+    {
+        // full resolution size of vote image
+        const cv::Size vote_sz = (is_half_votes) ? rkeyimg.size() : rfull_sz;
+        const int xmax = (is_half_votes) ? (2 * vote_sz.width) : vote_sz.width;
+        const int ymax = (is_half_votes) ? (2 * vote_sz.height) : vote_sz.height;
+        const int vshift = (is_half_votes) ? 1 : 0;
+
+        rvotes = cv::Mat::zeros(vote_sz, E_VOTE_IMG_TYPE);
+        for (int i = 1; i < (rkeyimg.rows - 1); i += ijstep)
+        {
+            const T_KEY * pix = rkeyimg.ptr<T_KEY>(i);
+            for (int j = 1; j < (rkeyimg.cols - 1); j += ijstep)
+            {
+                const T_KEY uu = pix[j];
+                const size_t ct = rtable.elems[uu].size();
+                for (size_t k = 0; k < ct; ++k)
+                {
+                    // check bounds at full resolution before any shift so it never sees a negative position
+                    const cv::Point& rp = rtable.elems[uu][k];
+                    const int fx = (2 * j + rp.x);
+                    const int fy = (2 * i + rp.y);
+                    if ((fx >= 0) && (fx < xmax) &&
+                        (fy >= 0) && (fy < ymax))
+                    {
+                        T_VOTE * pvote = rvotes.ptr<T_VOTE>(fy >> vshift) + (fx >> vshift);
+                        (*pvote)++;
+                    }
+                }
+            }
+        }
+    }
+
+
+    // Adds votes for the pixels in one row of an encoded "key" image from column jbegin up to (not including) jend.
+    // Votes are range-checked if requested.  Votes that would fall outside the image are discarded.
+    template<typename T_KEY, typename T_VOTE>
+    void vote_row_pixels(
+        const T_KEY * pix,
+        const int i,
+        const int jbegin,
+        const int jend,
+        const int ijstep,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        const bool is_checked)
+    {
+        for (int j = jbegin; j < jend; j += ijstep)
+        {
+            const T_KEY uu = pix[j];
+            const size_t ct = rtable.elems[uu].size();
+            for (size_t k = 0; k < ct; ++k)
+            {
+                const cv::Point& rp = rtable.elems[uu][k];
+                const int mx = (j + rp.x);
+                const int my = (i + rp.y);
+                if (!is_checked ||
+                    ((mx >= 0) && (mx < rvotes.cols) &&
+                    (my >= 0) && (my < rvotes.rows)))
+                {
+                    T_VOTE * pvote = rvotes.ptr<T_VOTE>(my) + mx;
+                    (*pvote)++;
+                }
+            }
+        }
+    }
+
+
+    // Region of an image where every vote from a table is known to land inside the image.
+    // It may be empty if the table extents are bigger than the image.
+    class InteriorRegion
+    {
+    public:
+        InteriorRegion(const cv::Size& rimg_sz, const cv::Rect& rext, const int ijstep)
+        {
+            // pixel (i,j) is interior if i + ymin >= 0 and i + ymax < rows, same for columns
+            i0 = -rext.y;
+            i1 = rimg_sz.height - (rext.y + rext.height - 1);
+
+            // first interior column on the grid, end of interior, and first column on the grid after interior
+            jlo = std::min(get_first_on_grid(1, ijstep, -rext.x), rimg_sz.width - 1);
+            jhi = std::max(jlo, std::min(rimg_sz.width - 1, rimg_sz.width - (rext.x + rext.width - 1)));
+            jright = get_first_on_grid(jlo, ijstep, jhi);
+        }
+        bool is_interior_row(const int i) const { return (i >= i0) && (i < i1); }
+    public:
+        int i0;
+        int i1;
+        int jlo;
+        int jhi;
+        int jright;
+    };
+
+
+    // Applies Generalized Hough transform to an encoded "key" image.
+    // Same results as apply_ghough_transform_allpix but the image is split into an interior region
+    // where every vote is known to land inside the output image and a border region where votes are checked.
+    // The table extents determine the interior region.
+    template<typename T_KEY, int E_VOTE_IMG_TYPE, typename T_VOTE>
+    void apply_ghough_transform_split(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        const int ijstep = 1)
+    {
+        rvotes = cv::Mat::zeros(rkeyimg.size(), E_VOTE_IMG_TYPE);
+        const InteriorRegion rgn(rkeyimg.size(), rtable.extents, ijstep);
+        for (int i = 1; i < (rkeyimg.rows - 1); i += ijstep)
+        {
+            const T_KEY * pix = rkeyimg.ptr<T_KEY>(i);
+            if (rgn.is_interior_row(i))
+            {
+                // left border, interior, and right border
+                vote_row_pixels<T_KEY, T_VOTE>(pix, i, 1, rgn.jlo, ijstep, rvotes, rtable, true);
+                vote_row_pixels<T_KEY, T_VOTE>(pix, i, rgn.jlo, rgn.jhi, ijstep, rvotes, rtable, false);
+                vote_row_pixels<T_KEY, T_VOTE>(pix, i, rgn.jright, rkeyimg.cols - 1, ijstep, rvotes, rtable, true);
+            }
+            else
+            {
+                vote_row_pixels<T_KEY, T_VOTE>(pix, i, 1, rkeyimg.cols - 1, ijstep, rvotes, rtable, true);
+            }
+        }
+    }
+
+
+    // Table entries flattened into one array with the entries for each key stored together.
+    // Each entry also has its offset in elements within a vote image with a given row stride
+    // so a vote that does not need range-checking is a single indexed add.
+    class FlatLookupTable
+    {
+    public:
+        FlatLookupTable() : stride(0), generation(0) {}
+        virtual ~FlatLookupTable() {}
+        void build(const ghalgo::LookupTable& rtable, const int row_stride)
+        {
+            // nothing to do if already built from same table with same stride
+            // vectors are cleared instead of re-created so memory is re-used
+            if ((stride != row_stride) || (generation != rtable.generation))
+            {
+                stride = row_stride;
+                generation = rtable.generation;
+                start.clear();
+                points.clear();
+                offsets.clear();
+                for (const auto& rvec : rtable.elems)
+                {
+                    start.push_back(points.size());
+                    for (const auto& rpt : rvec)
+                    {
+                        points.push_back(rpt);
+                        offsets.push_back(static_cast<ptrdiff_t>(rpt.y) * stride + rpt.x);
+                    }
+                }
+                start.push_back(points.size());
+            }
+        }
+        size_t memory_usage() const
+        {
+            return (start.capacity() * sizeof(size_t)) + (points.capacity() * sizeof(cv::Point)) + (offsets.capacity() * sizeof(ptrdiff_t));
+        }
+    public:
+        int stride;
+        uint64_t generation;                // generation of table that was flattened (0 if none)
+        std::vector<size_t> start;          // index of first entry for each key plus end index
+        std::vector<cv::Point> points;
+        std::vector<ptrdiff_t> offsets;
+    };
+
+
+    // Adds votes for the pixels in one row of an encoded "key" image from column jbegin up to (not including) jend.
+    // Same as vote_row_pixels but the loop step and range-checking are fixed at compile time
+    // so the compiler can unroll and simplify the loops for each combination.
+    template<typename T_KEY, typename T_VOTE, int IJSTEP, bool IS_CHECKED>
+    void vote_row_pixels_fixed(
+        const T_KEY * pix,
+        const int i,
+        const int jbegin,
+        const int jend,
+        cv::Mat& rvotes,
+        const ghalgo::FlatLookupTable& rflat)
+    {
+        const size_t * pstart = rflat.start.data();
+        for (int j = jbegin; j < jend; j += IJSTEP)
+        {
+            const T_KEY uu = pix[j];
+            const size_t kbegin = pstart[uu];
+            const size_t kend = pstart[uu + 1];
+            if (IS_CHECKED)
+            {
+                const cv::Point * ppt = rflat.points.data();
+                for (size_t k = kbegin; k < kend; ++k)
+                {
+                    const int mx = (j + ppt[k].x);
+                    const int my = (i + ppt[k].y);
+                    if ((mx >= 0) && (mx < rvotes.cols) &&
+                        (my >= 0) && (my < rvotes.rows))
+                    {
+                        rvotes.ptr<T_VOTE>(my)[mx]++;
+                    }
+                }
+            }
+            else
+            {
+                const ptrdiff_t * poff = rflat.offsets.data();
+                T_VOTE * pcenter = rvotes.ptr<T_VOTE>(i) + j;
+                for (size_t k = kbegin; k < kend; ++k)
+                {
+                    pcenter[poff[k]]++;
+                }
+            }
+        }
+    }
+
+
+    // Applies Generalized Hough transform to an encoded "key" image with a loop step fixed at compile time.
+    // Same results as apply_ghough_transform_allpix.  It uses the same interior and border split as
+    // apply_ghough_transform_split with a flattened table that is passed in so it is only rebuilt
+    // when the table or the vote image stride changes.
+    template<typename T_KEY, int E_VOTE_IMG_TYPE, typename T_VOTE, int IJSTEP>
+    void apply_ghough_transform_fixed(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        ghalgo::FlatLookupTable& rflat)
+    {
+        rvotes = cv::Mat::zeros(rkeyimg.size(), E_VOTE_IMG_TYPE);
+        rflat.build(rtable, static_cast<int>(rvotes.step / sizeof(T_VOTE)));
+        const InteriorRegion rgn(rkeyimg.size(), rtable.extents, IJSTEP);
+        for (int i = 1; i < (rkeyimg.rows - 1); i += IJSTEP)
+        {
+            const T_KEY * pix = rkeyimg.ptr<T_KEY>(i);
+            if (rgn.is_interior_row(i))
+            {
+                vote_row_pixels_fixed<T_KEY, T_VOTE, IJSTEP, true>(pix, i, 1, rgn.jlo, rvotes, rflat);
+                vote_row_pixels_fixed<T_KEY, T_VOTE, IJSTEP, false>(pix, i, rgn.jlo, rgn.jhi, rvotes, rflat);
+                vote_row_pixels_fixed<T_KEY, T_VOTE, IJSTEP, true>(pix, i, rgn.jright, rkeyimg.cols - 1, rvotes, rflat);
+            }
+            else
+            {
+                vote_row_pixels_fixed<T_KEY, T_VOTE, IJSTEP, true>(pix, i, 1, rkeyimg.cols - 1, rvotes, rflat);
+            }
+        }
+    }
+
+
+    // Largest loop step with a specialized kernel
+    constexpr int FIXED_GHOUGH_MAX_STEP = 4;
+
+    typedef void(*T_FIXED_GHOUGH_KERNEL)(
+        const cv::Mat&, cv::Mat&, const ghalgo::LookupTable&, ghalgo::FlatLookupTable&);
+
+    // Returns the specialized kernel for a loop step from a dispatch table.
+    // Returns null if there is no kernel for the loop step.  Examples for the vote types:
+    // - 8-bit votes:   <uint8_t,CV_8U,uint8_t>
+    // - 16-bit votes:  <uint8_t,CV_16U,uint16_t>
+    // - 32-bit votes:  <uint8_t,CV_32S,int32_t>
+    template<typename T_KEY, int E_VOTE_IMG_TYPE, typename T_VOTE>
+    ghalgo::T_FIXED_GHOUGH_KERNEL get_fixed_ghough_kernel(const int ijstep)
+    {
+        static const ghalgo::T_FIXED_GHOUGH_KERNEL kernels[FIXED_GHOUGH_MAX_STEP] =
+        {
+            &apply_ghough_transform_fixed<T_KEY, E_VOTE_IMG_TYPE, T_VOTE, 1>,
+            &apply_ghough_transform_fixed<T_KEY, E_VOTE_IMG_TYPE, T_VOTE, 2>,
+            &apply_ghough_transform_fixed<T_KEY, E_VOTE_IMG_TYPE, T_VOTE, 3>,
+            &apply_ghough_transform_fixed<T_KEY, E_VOTE_IMG_TYPE, T_VOTE, 4>,
+        };
+        return ((ijstep >= 1) && (ijstep <= FIXED_GHOUGH_MAX_STEP)) ? kernels[ijstep - 1] : nullptr;
+    }
+
+
+    // Adds votes for a band of rows in an encoded "key" image to an existing vote image.
+    // Only rows from ibegin up to (not including) iend that are on the loop step grid are processed.
+    // Calling this for consecutive bands that cover the image gives the same votes as apply_ghough_transform_allpix.
+    template<typename T_KEY, typename T_VOTE>
+    void add_ghough_votes_for_rows(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        const int ibegin,
+        const int iend,
+        const int ijstep = 1)
+    {
+        const int ilast = std::min(iend, rkeyimg.rows - 1);
+        for (int i = get_first_on_grid(1, ijstep, ibegin); i < ilast; i += ijstep)
+        {
+            vote_row_pixels<T_KEY, T_VOTE>(rkeyimg.ptr<T_KEY>(i), i, 1, rkeyimg.cols - 1, ijstep, rvotes, rtable, true);
+        }
+    }
+
+
+    // Adds votes that land in a band of output rows from obegin up to (not including) oend.
+    // Only the input rows that can reach the band are visited and no votes are written outside of it,
+    // so different bands can be voted at the same time without locks.
+    // The table entries must be sorted by row offset (see sort_lookup_table_rows).  For each key
+    // the entries that land in the band from the current input row are found with the row histogram.
+    // The ranges are passed in so their memory can be re-used.
+    template<typename T_KEY, typename T_VOTE>
+    void add_ghough_votes_to_band(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rsorted,
+        const int obegin,
+        const int oend,
+        std::vector<std::pair<size_t, size_t>>& rranges,
+        const int ijstep = 1)
+    {
+        const cv::Rect& ext = rsorted.extents;
+        if (!ext.empty())
+        {
+            // input row i reaches output rows i + ymin to i + ymax
+            const int ymin = ext.y;
+            const int ymax = ext.y + ext.height - 1;
+            const int ilast = std::min(oend - ymin, rkeyimg.rows - 1);
+            rranges.resize(rsorted.elems.size());
+            for (int i = get_first_on_grid(1, ijstep, obegin - ymax); i < ilast; i += ijstep)
+            {
+                // entries with row offset from obegin - i up to (not including) oend - i
+                // keys whose extents miss the band entirely are skipped
+                for (size_t uu = 0; uu < rsorted.elems.size(); ++uu)
+                {
+                    const std::vector<cv::Point>& rvec = rsorted.elems[uu];
+                    const cv::Rect& rkext = rsorted.key_extents[uu];
+                    if (rvec.empty() || ((i + rkext.y) >= oend) || ((i + rkext.y + rkext.height) <= obegin))
+                    {
+                        rranges[uu] = std::make_pair<size_t, size_t>(0, 0);
+                    }
+                    else
+                    {
+                        // sorting does not change the histogram so it gives the positions in the sorted entries
+                        rranges[uu].first = static_cast<size_t>(rsorted.get_key_rows_below(uu, obegin - i - ymin));
+                        rranges[uu].second = static_cast<size_t>(rsorted.get_key_rows_below(uu, oend - i - ymin));
+                    }
+                }
+
+                // rows are guaranteed to be in band so only columns need checking
+                const T_KEY * pix = rkeyimg.ptr<T_KEY>(i);
+                for (int j = 1; j < (rkeyimg.cols - 1); j += ijstep)
+                {
+                    const T_KEY uu = pix[j];
+                    const std::vector<cv::Point>& rvec = rsorted.elems[uu];
+                    for (size_t k = rranges[uu].first; k < rranges[uu].second; ++k)
+                    {
+                        const cv::Point& rp = rvec[k];
+                        const int mx = (j + rp.x);
+                        if ((mx >= 0) && (mx < rvotes.cols))
+                        {
+                            T_VOTE * pvote = rvotes.ptr<T_VOTE>(i + rp.y) + mx;
+                            (*pvote)++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+
+    // Applies Generalized Hough transform to an encoded "key" image.
+    // Same results as apply_ghough_transform_allpix but the voting is done key-by-key.
+    // First the non-zero pixels are gathered into a list for each key.  Then for each table entry
+    // a vote is cast for every pixel with that key.  The table entry stays in a register and the votes
+    // sweep through the output image in raster order.  This is good for sparse edges and big tables.
+    // The lists are passed in so their memory can be re-used from frame to frame.
+    template<typename T_KEY, int E_VOTE_IMG_TYPE, typename T_VOTE>
+    void apply_ghough_transform_sparse(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        std::vector<std::vector<cv::Point>>& ractive,
+        const int ijstep = 1)
+    {
+        rvotes = cv::Mat::zeros(rkeyimg.size(), E_VOTE_IMG_TYPE);
+
+        // gather pixels that have entries in table
+        ractive.resize(rtable.elems.size());
+        for (auto& rvec : ractive)
+        {
+            rvec.clear();
+        }
+        for (int i = 1; i < (rkeyimg.rows - 1); i += ijstep)
+        {
+            const T_KEY * pix = rkeyimg.ptr<T_KEY>(i);
+            for (int j = 1; j < (rkeyimg.cols - 1); j += ijstep)
+            {
+                const T_KEY uu = pix[j];
+                if ((uu < rtable.elems.size()) && rtable.elems[uu].size())
+                {
+                    ractive[uu].push_back(cv::Point(j, i));
+                }
+            }
+        }
+
+        // vote key-by-key and entry-by-entry
+        for (size_t uu = 0; uu < rtable.elems.size(); ++uu)
+        {
+            const std::vector<cv::Point>& rvpix = ractive[uu];
+            for (const auto& rp : rtable.elems[uu])
+            {
+                for (const auto& rpix : rvpix)
+                {
+                    // only vote if pixel is within output image bounds
+                    const int mx = (rpix.x + rp.x);
+                    const int my = (rpix.y + rp.y);
+                    if ((mx >= 0) && (mx < rvotes.cols) &&
+                        (my >= 0) && (my < rvotes.rows))
+                    {
+                        T_VOTE * pvote = rvotes.ptr<T_VOTE>(my) + mx;
+                        (*pvote)++;
+                    }
+                }
+            }
+        }
+    }
+
+
+    // Scratch data for apply_ghough_transform_fft.
+    // The spectrum of the table entries for a key is kept until the table or the transform size changes.
+    class FftVoteScratch
+    {
+    public:
+        FftVoteScratch() : generation(0) {}
+        size_t memory_usage() const
+        {
+            size_t result = 0;
+            for (const auto& r : spectra)
+            {
+                result += get_mat_bytes(r);
+            }
+            for (const auto& r : active)
+            {
+                result += r.capacity() * sizeof(cv::Point);
+            }
+            result += get_mat_bytes(mask) + get_mat_bytes(mask_spectrum) + get_mat_bytes(product);
+            result += get_mat_bytes(sum_spectrum) + get_mat_bytes(sum);
+            return result;
+        }
+    public:
+        cv::Size dft_sz;
+        uint64_t generation;                        // generation of table used for spectra (0 if none)
+        std::vector<cv::Mat> spectra;
+        std::vector<std::vector<cv::Point>> active;
+        cv::Mat mask;
+        cv::Mat mask_spectrum;
+        cv::Mat product;
+        cv::Mat sum_spectrum;
+        cv::Mat sum;
+    };
+
+
+    // Returns rough cost of a 2D DFT of a given size in units of a single vote.
+    inline double get_dft_cost(const cv::Size& rsz)
+    {
+        const double n = static_cast<double>(rsz.area());
+        return n * std::log2(std::max(2.0, n));
+    }
+
+
+    // Returns size of the DFT used by apply_ghough_transform_fft for an image size and table extents.
+    // It has room for the image plus the table extents so the convolution does not wrap around.
+    inline cv::Size get_ghough_dft_size(const cv::Size& rimg_sz, const cv::Rect& rext)
+    {
+        const int kw = std::max(rext.x + rext.width, 1) - std::min(rext.x, 0);
+        const int kh = std::max(rext.y + rext.height, 1) - std::min(rext.y, 0);
+        return cv::Size(
+            cv::getOptimalDFTSize(rimg_sz.width + kw - 1),
+            cv::getOptimalDFTSize(rimg_sz.height + kh - 1));
+    }
+
+
+    // Applies Generalized Hough transform to an encoded "key" image.
+    // Same results as apply_ghough_transform_allpix but the votes are computed with DFTs.
+    // The votes are a sum over keys of (mask of pixels with key) convolved with (mask of table entries for key).
+    // A key is done in the frequency domain when its pixel count times its entry count costs more than a DFT
+    // (the DFT cost is multiplied by a scale so a scale of 0 does every key with pixels and entries that way).
+    // Its mask spectrum is multiplied by the table spectrum and added to a running sum, and one inverse DFT
+    // at the end gives the votes for all of those keys.  Other keys are voted directly as in the sparse engine.
+    // So the cost for big dense tables does not grow with the template size.
+    // Sums are done in double precision and rounded so the results are exact.
+    template<typename T_KEY, int E_VOTE_IMG_TYPE, typename T_VOTE>
+    void apply_ghough_transform_fft(
+        const cv::Mat& rkeyimg,
+        cv::Mat& rvotes,
+        const ghalgo::LookupTable& rtable,
+        ghalgo::FftVoteScratch& rscratch,
+        const int ijstep = 1,
+        const double dft_cost_scale = 1.0)
+    {
+        rvotes = cv::Mat::zeros(rkeyimg.size(), E_VOTE_IMG_TYPE);
+        const cv::Rect& ext = rtable.extents;
+        if (!ext.empty())
+        {
+            // table entries are shifted so the smallest (or 0) offset is at the origin of the DFT
+            const cv::Point origin(std::min(ext.x, 0), std::min(ext.y, 0));
+            const cv::Size dft_sz = get_ghough_dft_size(rkeyimg.size(), ext);
+            if ((dft_sz != rscratch.dft_sz) || (rtable.generation != rscratch.generation))
+            {
+                rscratch.dft_sz = dft_sz;
+                rscratch.generation = rtable.generation;
+                rscratch.spectra.clear();
+                rscratch.spectra.resize(rtable.elems.size());
+                rscratch.mask = cv::Mat::zeros(dft_sz, CV_64F);
+            }
+
+            // gather pixels that have entries in table
+            rscratch.active.resize(rtable.elems.size());
+            for (auto& rvec : rscratch.active)
+            {
+                rvec.clear();
+            }
+            for (int i = 1; i < (rkeyimg.rows - 1); i += ijstep)
+            {
+                const T_KEY * pix = rkeyimg.ptr<T_KEY>(i);
+                for (int j = 1; j < (rkeyimg.cols - 1); j += ijstep)
+                {
+                    const T_KEY uu = pix[j];
+                    if ((uu < rtable.elems.size()) && rtable.elems[uu].size())
+                    {
+                        rscratch.active[uu].push_back(cv::Point(j, i));
+                    }
+                }
+            }
+
+            const double dft_cost = dft_cost_scale * get_dft_cost(dft_sz);
+            bool is_dft_used = false;
+            for (size_t uu = 0; uu < rtable.elems.size(); ++uu)
+            {
+                const std::vector<cv::Point>& rvpix = rscratch.active[uu];
+                const std::vector<cv::Point>& rventry = rtable.elems[uu];
+                if ((static_cast<double>(rvpix.size()) * rventry.size()) > dft_cost)
+                {
+                    // spectrum of table entries for this key is only computed the first time it is needed
+                    // the mask is cleared after each use so it does not have to be zeroed every time
+                    cv::Mat& rspectrum = rscratch.spectra[uu];
+                    if (rspectrum.empty())
+                    {
+                        for (const auto& rp : rventry)
+                        {
+                            rscratch.mask.at<double>(rp.y - origin.y, rp.x - origin.x) += 1.0;
+                        }
+                        cv::dft(rscratch.mask, rspectrum);
+                        for (const auto& rp : rventry)
+                        {
+                            rscratch.mask.at<double>(rp.y - origin.y, rp.x - origin.x) = 0.0;
+                        }
+                    }
+
+                    for (const auto& rpix : rvpix)
+                    {
+                        rscratch.mask.at<double>(rpix.y, rpix.x) = 1.0;
+                    }
+                    cv::dft(rscratch.mask, rscratch.mask_spectrum, 0, rkeyimg.rows);
+                    for (const auto& rpix : rvpix)
+                    {
+                        rscratch.mask.at<double>(rpix.y, rpix.x) = 0.0;
+                    }
+
+                    if (is_dft_used)
+                    {
+                        cv::mulSpectrums(rscratch.mask_spectrum, rspectrum, rscratch.product, 0);
+                        rscratch.sum_spectrum += rscratch.product;
+                    }
+                    else
+                    {
+                        cv::mulSpectrums(rscratch.mask_spectrum, rspectrum, rscratch.sum_spectrum, 0);
+                        is_dft_used = true;
+                    }
+                }
+                else
+                {
+                    for (const auto& rp : rventry)
+                    {
+                        for (const auto& rpix : rvpix)
+                        {
+                            // only vote if pixel is within output image bounds
+                            const int mx = (rpix.x + rp.x);
+                            const int my = (rpix.y + rp.y);
+                            if ((mx >= 0) && (mx < rvotes.cols) &&
+                                (my >= 0) && (my < rvotes.rows))
+                            {
+                                T_VOTE * pvote = rvotes.ptr<T_VOTE>(my) + mx;
+                                (*pvote)++;
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (is_dft_used)
+            {
+                // votes for pixel (x,y) are at (x,y) minus the origin in the convolution
+                cv::dft(rscratch.sum_spectrum, rscratch.sum, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT);
+                for (int i = 0; i < rvotes.rows; ++i)
+                {
+                    const double * psum = rscratch.sum.ptr<double>(i - origin.y) - origin.x;
+                    T_VOTE * pvote = rvotes.ptr<T_VOTE>(i);
+                    for (int j = 0; j < rvotes.cols; ++j)
+                    {
+                        pvote[j] = static_cast<T_VOTE>(pvote[j] + static_cast<int64_t>(std::round(psum[j])));
+                    }
+                }
+            }
+        }
+    }
+
+
+    // Rolling window of vote image rows for voting on an image a few rows at a time.
+    // It only holds the vote rows that can still get votes from input rows that have not been added yet.
+    // When a row can no longer get any votes it is final and it can be read then released.
+    // Results are the same as apply_ghough_transform_allpix.
+    template<int E_VOTE_IMG_TYPE, typename T_VOTE>
+    class RollingVoteWindow
+    {
+    public:
+        RollingVoteWindow() : m_ptable(nullptr), m_img_sz(0, 0), m_row0(0), m_ymin(0) {}
+        virtual ~RollingVoteWindow() {}
+
+        // Sets up window for voting on an image with a table.
+        // The window is sized for adding up to max_rows input rows between releases of the final rows.
+        // The table must stay valid while the window is used.
+        void init(const cv::Size& rimg_sz, const ghalgo::LookupTable& rtable, const int max_rows)
+        {
+            const cv::Rect& rext = rtable.extents;
+            m_ptable = &rtable;
+            m_img_sz = rimg_sz;
+            m_row0 = 0;
+            m_ymin = (rext.empty()) ? 0 : rext.y;
+            // window covers the input rows plus the reach of the table above and below them
+            // (any offsets that are all positive or all negative still reach from row 0)
+            const int ymax = (rext.empty()) ? 0 : (rext.y + rext.height - 1);
+            const int reach = std::max(ymax, 0) - std::min(m_ymin, 0);
+            m_window = cv::Mat::zeros(std::max(1, max_rows) + reach, rimg_sz.width, E_VOTE_IMG_TYPE);
+        }
+
+        // Adds votes for row i of the input image.
+        // Only rows and columns on the loop step grid (1, 1 + ijstep, ...) vote, same as allpix.
+        // Votes that fall outside the image are discarded.
+        template<typename T_KEY>
+        void add_row(const T_KEY * pix, const int i, const int ijstep = 1)
+        {
+            if ((i >= 1) && (i < (m_img_sz.height - 1)) && (((i - 1) % ijstep) == 0))
+            {
+                const ghalgo::LookupTable& rtable = *m_ptable;
+                for (int j = 1; j < (m_img_sz.width - 1); j += ijstep)
+                {
+                    const T_KEY uu = pix[j];
+                    const size_t ct = rtable.elems[uu].size();
+                    for (size_t k = 0; k < ct; ++k)
+                    {
+                        const cv::Point& rp = rtable.elems[uu][k];
+                        const int mx = (j + rp.x);
+                        const int my = (i + rp.y);
+                        if ((mx >= 0) && (mx < m_img_sz.width) &&
+                            (my >= 0) && (my < m_img_sz.height))
+                        {
+                            T_VOTE * pvote = m_window.ptr<T_VOTE>(my - m_row0) + mx;
+                            (*pvote)++;
+                        }
+                    }
+                }
+            }
+        }
+
+        // Returns number of rows that are final once every input row before next_row has been added.
+        // The final rows start at get_first_row().
+        int get_final_count(const int next_row) const
+        {
+            const int row_end = (next_row >= m_img_sz.height) ? m_img_sz.height : std::min(m_img_sz.height, next_row + m_ymin);
+            return std::max(0, row_end - m_row0);
+        }
+
+        // Returns image row of first row in window.
+        int get_first_row(void) const { return m_row0; }
+
+        // Returns the first rows in the window.  This is a view that changes when rows are released.
+        cv::Mat get_rows(const int count) const { return m_window.rowRange(0, count); }
+
+        // Releases the first rows in the window and slides the rest up.
+        void release_rows(const int count)
+        {
+            const size_t row_bytes = m_window.cols * m_window.elemSize();
+            for (int k = 0; k < (m_window.rows - count); ++k)
+            {
+                std::memcpy(m_window.ptr(k), m_window.ptr(k + count), row_bytes);
+            }
+            for (int k = std::max(0, m_window.rows - count); k < m_window.rows; ++k)
+            {
+                std::memset(m_window.ptr(k), 0, row_bytes);
+            }
+            m_row0 += count;
+        }
+
+    private:
+
+        const ghalgo::LookupTable * m_ptable;
+        cv::Size m_img_sz;
+        cv::Mat m_window;
+        int m_row0;
+        int m_ymin;
+    };
 }
 
 #endif // GHBASE_H_
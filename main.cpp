@@ -25,13 +25,23 @@
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/highgui.hpp"
 
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <vector>
 #include <list>
 
+#include "Evaluator.h"
+#include "FrameExecutor.h"
 #include "GradientMatcher.h"
+#include "PerfCounters.h"
+#include "SceneGenerator.h"
+#include "StreamingMatcher.h"
+#include "TemplateCache.h"
+#include "TemplateCatalog.h"
+#include "Verifier.h"
 #include "Knobs.h"
 #include "util.h"
 
@@ -39,6 +49,8 @@
 #define MATCH_DISPLAY_THRESHOLD (0.9)           // arbitrary
 #define MOVIE_PATH              ".\\movie\\"    // user may need to create or change this
 #define DATA_PATH               ".\\data\\"     // user may need to change this
+#define ENGINE_PROFILE          "engine_profile.yml"    // voting engine timings from previous runs
+#define TEMPLATE_MAX_BYTES      (8 * 1024 * 1024)       // templates are subsampled if they are bigger
 
 
 using namespace cv;
@@ -92,6 +104,8 @@ Size g_viewer_size;
 MouseInfo g_mouse_info;
 
 ghalgo::GradientMatcher theMatcher;
+ghalgo::TemplateCache theTemplateCache;
+std::vector<double> theBackgroundCounts;
 const char * stitle = "CGHMatcher";
 const double default_mag_thr = 0.2;
 int n_record_ctr = 0;
@@ -207,7 +221,7 @@ static void image_output(
         const int h_score = 16;
         const int w_score = 40;
 
-        if (rknobs.get_template_display_enabled())
+        if (rknobs.get_template_display_enabled() && !template_image.empty())
         {
             // draw current template in upper right corner
             Mat bgr_template_img;
@@ -223,16 +237,17 @@ static void image_output(
         }
 
         // determine size of "target" box
-        Size rsz = theMatcher.m_ghtable.img_sz;
+        Size rsz = theMatcher.get_template_size();
         Point corner = { rptmax.x - rsz.width / 2, rptmax.y - rsz.height / 2 };
 
         // a loop step of 2 means 1/4 of the pixels will be processed, 3 means 1/9 will be processed, etc.
         // so the score can be adjusted by the squared loop step to keep it consistent for different step values
-        double step_scale = static_cast<double>(theMatcher.m_loopstep * theMatcher.m_loopstep);
+        // (the matcher also adjusts for the resolution mode)
+        double step_scale = theMatcher.get_score_scale();
 
         // format score string for viewer (#.##)
         std::ostringstream oss;
-        oss << std::fixed << std::setprecision(2) << ((qmax / theMatcher.m_max_votes) * step_scale);
+        oss << std::fixed << std::setprecision(2) << ((qmax / theMatcher.get_max_votes()) * step_scale);
 
         // draw black background box then draw text score on top of it
         // dispaly location is adjusted based on visible corners (default is upper left)
@@ -269,12 +284,73 @@ static void reload_template(
 {
     // with more "knobs" the magnitude threshold and angle step setting could also be re-applied here
     // but right now only the pre-blur Gaussian kernel size and Sobel kernel size can be adjusted on the fly
+    // templates that have been compiled before with the same settings come from the cache
+    // the old template stays in use until the new one is published
     std::string spath = DATA_PATH + rinfo.sname;
-    theMatcher.init(rknobs.get_pre_blur(), rknobs.get_ksobel(), rinfo.mag_thr);
-    theMatcher.load_template(template_image, spath, rinfo.img_scale);
-    std::cout << "LOADED:  blur=" << rknobs.get_pre_blur() << ", sobel=" << rknobs.get_ksobel();
-    std::cout << ", magthr=" << rinfo.mag_thr << ", " << rinfo.sname << " ";
-    std::cout << theMatcher.m_max_votes << std::endl;
+    ghalgo::TemplateParams params(rknobs.get_pre_blur(), rknobs.get_ksobel(), rinfo.mag_thr);
+    params.subsample = rknobs.get_subsample();
+    params.max_bytes = TEMPLATE_MAX_BYTES;
+    params.budget_policy = ghalgo::TemplateParams::BUDGET_COMPACT;
+    Mat img_loaded;
+    std::shared_ptr<const ghalgo::CompiledTemplate> ptemplate;
+    bool is_cached = theTemplateCache.get(ghalgo::TemplateKey(spath, rinfo.img_scale, params), img_loaded, ptemplate);
+
+    // optionally prune the table to make voting faster
+    double sharpness = 1.0;
+    double prune_ratio = rknobs.get_prune_ratio();
+    if (ptemplate && (prune_ratio < 1.0))
+    {
+        ptemplate = ghalgo::prune_template(*ptemplate, prune_ratio, sharpness);
+    }
+
+    // optionally thin out keys that are much more common in the background than in the template
+    int keys_dropped = 0;
+    double key_ratio = rknobs.get_key_ratio();
+    bool is_weighted = (ptemplate && (key_ratio > 0.0) && !theBackgroundCounts.empty());
+    if (is_weighted)
+    {
+        ptemplate = ghalgo::weight_template_keys(*ptemplate, theBackgroundCounts, key_ratio, keys_dropped);
+    }
+
+    if (ptemplate)
+    {
+        // the old template stays in use if the new one could not be loaded
+        theMatcher.set_params(params);
+        theMatcher.set_template(ptemplate);
+        template_image = img_loaded;
+
+        std::cout << "LOADED:  blur=" << rknobs.get_pre_blur() << ", sobel=" << rknobs.get_ksobel();
+        std::cout << ", magthr=" << rinfo.mag_thr << ", " << rinfo.sname << " ";
+        std::cout << theMatcher.get_max_votes() << ((is_cached) ? " (cached)" : "");
+        if (ptemplate->params.subsample > 1.0)
+        {
+            // the subsample factor may have been raised to fit the memory budget
+            std::cout << ", subsample=" << ptemplate->params.subsample;
+        }
+        std::cout << ", bytes=" << ptemplate->memory_usage();
+        if (prune_ratio < 1.0)
+        {
+            std::cout << ", prune=" << prune_ratio << ", sharpness=" << sharpness;
+        }
+        if (is_weighted)
+        {
+            std::cout << ", key ratio=" << key_ratio << ", keys dropped=" << keys_dropped;
+        }
+        std::cout << std::endl;
+    }
+    else
+    {
+        std::cout << "Failed to load " << rinfo.sname << " so previous template is still in use" << std::endl;
+    }
+
+    // start compiling the next template in the collection in the background
+    // so it will be ready when the user selects it
+    const T_file_info& rnext = vfiles[(nfile + 1) % vfiles.size()];
+    ghalgo::TemplateParams next_params(rknobs.get_pre_blur(), rknobs.get_ksobel(), rnext.mag_thr);
+    next_params.subsample = rknobs.get_subsample();
+    next_params.max_bytes = TEMPLATE_MAX_BYTES;
+    next_params.budget_policy = ghalgo::TemplateParams::BUDGET_COMPACT;
+    theTemplateCache.prefetch(ghalgo::TemplateKey(DATA_PATH + rnext.sname, rnext.img_scale, next_params));
 }
 
 
@@ -355,6 +431,11 @@ static void loop(void)
     // initialize lookup table
     reload_template(theKnobs, vfiles[nfile]);
 
+    // live view has one matcher so let voting use all the cores
+    // and re-use voting engine timings from previous runs
+    theMatcher.get_vote_engine().set_thread_count(0);
+    theMatcher.get_vote_engine().load_profile(ENGINE_PROFILE);
+
     // and the image processing loop is running...
     bool is_running = true;
 
@@ -409,30 +490,58 @@ static void loop(void)
                     listOfPNG);
                 std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
             }
+            else if (op_id == Knobs::OP_BACKGROUND)
+            {
+                // point camera at scene without the target then sample it
+                // more samples can be added to get a better picture of the background
+                ghalgo::add_background_key_counts(theMatcher.get_params(), img_gray, theBackgroundCounts);
+                std::cout << "BACKGROUND SAMPLED" << std::endl;
+                reload_template(theKnobs, vfiles[nfile]);
+            }
+            else if (op_id == Knobs::OP_MEMORY)
+            {
+                ghalgo::MemoryUsage mem = theMatcher.get_memory_usage();
+                std::cout << "MEMORY:  table=" << mem.table << ", key image=" << mem.keyimg;
+                std::cout << ", buffers=" << mem.buffers << ", engine=" << mem.engine;
+                std::cout << ", total=" << mem.total() << " bytes" << std::endl;
+            }
         }
 
+        // set loop iteration step
+        // this will skip points in the input image for significant speed-up
+        // then apply Generalized Hough transform and locate maximum (best match)
+        theMatcher.set_loopstep(theKnobs.get_loopstep());
+        theMatcher.set_res_mode(theKnobs.get_res_mode());
+        theMatcher.apply_ghough(img_gray, img_grad, img_match);
+        minMaxLoc(img_match, nullptr, &qmax, nullptr, &ptmax);
+
+        // the half resolution modes give a smaller gradient image
+        // and possibly a smaller match image so scale them up for display
+        if (img_match.size() != img_gray.size())
+        {
+            ptmax = Point(ptmax.x * 2, ptmax.y * 2);
+            resize(img_match, img_match, img_gray.size(), 0.0, 0.0, INTER_NEAREST);
+        }
+        if (img_grad.size() != img_gray.size())
+        {
+            resize(img_grad, img_grad, img_gray.size(), 0.0, 0.0, INTER_NEAREST);
+        }
+        update_ptfifo(ptmax);
+
         if (g_mouse_info.mstate == MouseInfo::MACQ)
         {
             // use the PRE-PROCESSED image in the acquisition rectangle as the new template
             // apply the current Sobel filter size since this is used directly in the gradient calc
-            Mat acq_img = img_gray(g_mouse_info.rect);
-            theMatcher.m_ksobel = theKnobs.get_ksobel();
-            theMatcher.m_magthr = default_mag_thr;
-            theMatcher.init_ghough_table_from_img(acq_img);
-            acq_img.copyTo(template_image);
+            // the gradients just calculated for the whole image are reused if they have the same Sobel size
+            theMatcher.set_params(ghalgo::TemplateParams(theKnobs.get_pre_blur(), theKnobs.get_ksobel(), default_mag_thr));
+            theMatcher.init_ghough_table_from_roi(img_gray, g_mouse_info.rect);
+            // make a copy since the previous template image may be shared with the template cache
+            template_image = img_gray(g_mouse_info.rect).clone();
             theKnobs.toggle_acq_mode_enabled();
             g_mouse_info.apply(false);
             std::cout << "New template acquired from camera" << std::endl;
         }
 
-        // set loop iteration step
-        // this will skip points in the input image for significant speed-up
-        // then apply Generalized Hough transform and locate maximum (best match)
-        theMatcher.m_loopstep = theKnobs.get_loopstep();
-        theMatcher.apply_ghough(img_gray, img_grad, img_match);
-        minMaxLoc(img_match, nullptr, &qmax, nullptr, &ptmax);
-        update_ptfifo(ptmax);
-
         if (theKnobs.get_feedback_mode_enabled())
         {
             // extact smaller region centered in current image
@@ -444,8 +553,7 @@ static void loop(void)
             Size tsz0 = { tsz.width - woff, tsz.height - hoff };
             Point tpt0 = { (woff / 2), (hoff / 2) };
             Rect qrectex = Rect(tpt0, tsz0);
-            Mat imgex = img_gray(qrectex);
-            theMatcher.init_ghough_table_from_img(imgex);
+            theMatcher.init_ghough_table_from_roi(img_gray, qrectex);
         }
 
         // apply the current output mode
@@ -502,14 +610,741 @@ static void loop(void)
         is_running = wait_and_check_keys(theKnobs);
     }
 
-    // when everything is done, release the capture device and windows
+    // when everything is done, save voting engine timings, and release the capture device and windows
+    theMatcher.get_vote_engine().save_profile(ENGINE_PROFILE);
     vcap.release();
     destroyAllWindows();
 }
 
 
+static void run_catalog_compiler(const std::string& rsdir, const std::string& rsoutfile)
+{
+    // use per-file settings if directory has a settings file
+    // otherwise use every PNG file in directory with default settings
+    std::vector<T_file_info> vinfo;
+    if (!ghalgo::load_catalog_settings(rsdir + "\\catalog.yml", vinfo))
+    {
+        std::list<std::string> listOfPNG;
+        get_dir_list(rsdir, "*.png", listOfPNG);
+        for (const auto& rs : listOfPNG)
+        {
+            vinfo.push_back({ default_mag_thr, 1.0, rs.substr(rsdir.size() + 1) });
+        }
+    }
+
+    std::cout << "COMPILING " << vinfo.size() << " TEMPLATES..." << std::endl;
+    std::vector<ghalgo::CatalogItem> vitems;
+    ghalgo::compile_catalog(rsdir + "\\", vinfo, ghalgo::TemplateParams(), vitems);
+
+    for (const auto& ritem : vitems)
+    {
+        const ghalgo::TemplateStats& rstats = ritem.stats;
+        std::cout << std::setw(32) << std::left << ritem.info.sname << std::right;
+        if (ritem.ptemplate)
+        {
+            std::cout << "  votes=" << std::setw(7) << rstats.max_votes;
+            std::cout << "  keys=" << std::setw(3) << rstats.keys_used;
+            std::cout << "  x=[" << rstats.extents.x << "," << rstats.extents.x + rstats.extents.width - 1 << "]";
+            std::cout << "  y=[" << rstats.extents.y << "," << rstats.extents.y + rstats.extents.height - 1 << "]";
+            std::cout << "  " << std::fixed << std::setprecision(1) << rstats.msec << "ms" << std::endl;
+        }
+        else
+        {
+            std::cout << "  FAILED" << std::endl;
+        }
+    }
+
+    bool is_ok = ghalgo::save_catalog(rsoutfile, vitems);
+    std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+}
+
+
+// Loads a template file with default settings into a matcher and returns the compiled template.
+// A message is printed and a null pointer is returned if it cannot be loaded.
+static std::shared_ptr<const ghalgo::CompiledTemplate> load_default_template(
+    ghalgo::GradientMatcher& rmatcher,
+    const std::string& rstemplate,
+    const double prescale)
+{
+    Mat img_template;
+    rmatcher.load_template(img_template, rstemplate, prescale);
+    std::shared_ptr<const ghalgo::CompiledTemplate> result = rmatcher.get_template();
+    if (!result)
+    {
+        std::cout << "Failed to load template!" << std::endl;
+    }
+    return result;
+}
+
+
+static void run_video_matcher(
+    const std::string& rsvideo,
+    const std::string& rstemplate,
+    const double prescale,
+    const size_t depth)
+{
+    VideoCapture vcap(rsvideo);
+    if (!vcap.isOpened())
+    {
+        std::cout << "Failed to open video file!" << std::endl;
+        ///////
+        return;
+        ///////
+    }
+
+    ghalgo::GradientMatcher matcher;
+    if (!load_default_template(matcher, rstemplate, prescale))
+    {
+        ///////
+        return;
+        ///////
+    }
+
+    // keep several frames in flight and print results in order
+    ghalgo::FrameExecutor executor(matcher, 0, depth);
+    ghalgo::FrameResult result;
+    auto print_result = [](const ghalgo::FrameResult& r)
+    {
+        std::cout << "frame=" << r.index << ", x=" << r.ptmax.x << ", y=" << r.ptmax.y;
+        std::cout << ", score=" << std::fixed << std::setprecision(3) << r.score << std::endl;
+    };
+
+    int64_t t0 = getTickCount();
+    size_t nframes = 0;
+    bool is_reading = true;
+    while (is_reading)
+    {
+        // each frame gets a new buffer since the executor does not copy it
+        Mat img;
+        vcap >> img;
+        is_reading = !img.empty();
+        if (is_reading)
+        {
+            if (executor.is_full())
+            {
+                executor.get_result(result);
+                print_result(result);
+            }
+            executor.submit(img);
+            nframes++;
+        }
+    }
+
+    while (executor.get_result(result))
+    {
+        print_result(result);
+    }
+
+    int64_t t1 = getTickCount();
+    double sec = static_cast<double>(t1 - t0) / getTickFrequency();
+    std::cout << "DONE:  " << std::fixed << std::setprecision(2) << sec << "s, ";
+    std::cout << nframes << " frames, " << ((sec > 0.0) ? (nframes / sec) : 0.0) << " fps" << std::endl;
+}
+
+
+// Times the generic voting loop and the kernel specialized for each loop step and checks that they match.
+// The best of several trials is reported for each.
+template<int E_VOTE_IMG_TYPE, typename T_VOTE>
+static void run_kernel_trials(const char * sname, const Mat& rkeyimg, const ghalgo::LookupTable& rtable)
+{
+    const int TRIALS = 10;
+    ghalgo::FlatLookupTable flat;
+    for (int ijstep = 1; ijstep <= ghalgo::FIXED_GHOUGH_MAX_STEP; ++ijstep)
+    {
+        Mat votes_generic;
+        Mat votes_fixed;
+        double msec_generic = 0.0;
+        double msec_fixed = 0.0;
+        ghalgo::T_FIXED_GHOUGH_KERNEL pfunc = ghalgo::get_fixed_ghough_kernel<uint8_t, E_VOTE_IMG_TYPE, T_VOTE>(ijstep);
+        for (int n = 0; n < TRIALS; ++n)
+        {
+            int64_t t0 = getTickCount();
+            ghalgo::apply_ghough_transform_allpix<uint8_t, E_VOTE_IMG_TYPE, T_VOTE>(rkeyimg, votes_generic, rtable, ijstep);
+            int64_t t1 = getTickCount();
+            pfunc(rkeyimg, votes_fixed, rtable, flat);
+            int64_t t2 = getTickCount();
+            double msec0 = (1000.0 * (t1 - t0)) / getTickFrequency();
+            double msec1 = (1000.0 * (t2 - t1)) / getTickFrequency();
+            msec_generic = (n == 0) ? msec0 : std::min(msec_generic, msec0);
+            msec_fixed = (n == 0) ? msec1 : std::min(msec_fixed, msec1);
+        }
+
+        bool is_same = (countNonZero(votes_generic != votes_fixed) == 0);
+        std::cout << sname << ", step=" << ijstep << std::fixed << std::setprecision(2);
+        std::cout << ", generic=" << msec_generic << "ms, fixed=" << msec_fixed << "ms";
+        std::cout << ", speedup=" << ((msec_fixed > 0.0) ? (msec_generic / msec_fixed) : 0.0);
+        std::cout << ((is_same) ? "" : ", MISMATCH!") << std::endl;
+    }
+}
+
+
+static void run_kernel_benchmark(
+    const std::string& rsimage,
+    const std::string& rstemplate,
+    const double prescale)
+{
+    Mat img = imread(rsimage);
+    if (img.empty())
+    {
+        std::cout << "Failed to load image!" << std::endl;
+        ///////
+        return;
+        ///////
+    }
+
+    ghalgo::GradientMatcher matcher;
+    std::shared_ptr<const ghalgo::CompiledTemplate> ptemplate = load_default_template(matcher, rstemplate, prescale);
+    if (!ptemplate)
+    {
+        ///////
+        return;
+        ///////
+    }
+
+    // encode image the same way as when matching
+    Mat img_gray;
+    Mat img_key;
+    ghalgo::MatcherContext ctx;
+    ghalgo::GradientMatcher::pre_process(ptemplate->params, img, img_gray);
+    ghalgo::GradientMatcher::create_masked_gradient_orientation_img(ptemplate->params, ctx, img_gray, img_key);
+
+    std::cout << "BENCHMARK:  " << img_key.cols << "x" << img_key.rows;
+    std::cout << ", votes=" << ptemplate->table.max_votes << std::endl;
+    run_kernel_trials<CV_8U, uint8_t>("8-bit", img_key, ptemplate->table);
+    run_kernel_trials<CV_16U, uint16_t>("16-bit", img_key, ptemplate->table);
+    run_kernel_trials<CV_32S, int32_t>("32-bit", img_key, ptemplate->table);
+}
+
+
+// Compares the resolution modes with the default (full resolution) mode.
+// Reports the best time of several trials, the score, the distance of the peak from the full resolution peak,
+// and the ratio of the peak to the highest vote outside a small neighborhood of the peak.
+static void run_resolution_benchmark(
+    const std::string& rsimage,
+    const std::string& rstemplate,
+    const double prescale)
+{
+    const int TRIALS = 10;
+    const std::vector<std::string> smodes({ "full", "half-keys", "half" });
+
+    Mat img = imread(rsimage);
+    if (img.empty())
+    {
+        std::cout << "Failed to load image!" << std::endl;
+        ///////
+        return;
+        ///////
+    }
+
+    ghalgo::GradientMatcher matcher;
+    std::shared_ptr<const ghalgo::CompiledTemplate> ptemplate = load_default_template(matcher, rstemplate, prescale);
+    if (!ptemplate)
+    {
+        ///////
+        return;
+        ///////
+    }
+
+    Mat img_gray;
+    ghalgo::MatcherContext ctx;
+    ghalgo::GradientMatcher::pre_process(ptemplate->params, img, img_gray);
+    std::cout << "BENCHMARK:  " << img_gray.cols << "x" << img_gray.rows;
+    std::cout << ", votes=" << ptemplate->table.max_votes << std::endl;
+
+    Point ptfull;
+    for (int nmode = ghalgo::GradientMatcher::RES_FULL; nmode <= ghalgo::GradientMatcher::RES_HALF; ++nmode)
+    {
+        Mat img_grad;
+        Mat img_match;
+        double msec = 0.0;
+        matcher.set_res_mode(nmode);
+        for (int n = 0; n < TRIALS; ++n)
+        {
+            int64_t t0 = getTickCount();
+            matcher.apply_ghough(ctx, img_gray, img_grad, img_match);
+            int64_t t1 = getTickCount();
+            double msec0 = (1000.0 * (t1 - t0)) / getTickFrequency();
+            msec = (n == 0) ? msec0 : std::min(msec, msec0);
+        }
+
+        // peak location at full resolution
+        double qmax;
+        Point ptmax;
+        minMaxLoc(img_match, nullptr, &qmax, nullptr, &ptmax);
+        const int vote_scale = img_gray.cols / img_match.cols;
+        Point ptpeak = Point(ptmax.x * vote_scale, ptmax.y * vote_scale);
+        ptfull = (nmode == ghalgo::GradientMatcher::RES_FULL) ? ptpeak : ptfull;
+
+        // highest vote outside a neighborhood that is a small fraction of the template size
+        double qside;
+        Size tsz = matcher.get_template_size();
+        Mat mask = Mat::ones(img_match.size(), CV_8U);
+        circle(mask, ptmax, std::max(1, std::min(tsz.width, tsz.height) / (4 * vote_scale)), Scalar(0), -1);
+        minMaxLoc(img_match, nullptr, &qside, nullptr, nullptr, mask);
+
+        Point ptdiff = ptpeak - ptfull;
+        std::cout << std::left << std::setw(10) << smodes[nmode] << std::right << std::fixed << std::setprecision(2);
+        std::cout << "  time=" << msec << "ms";
+        std::cout << ", score=" << std::setprecision(3) << ((qmax / ptemplate->max_votes) * matcher.get_score_scale());
+        std::cout << ", offset=" << std::setprecision(1) << std::sqrt(static_cast<double>(ptdiff.x * ptdiff.x + ptdiff.y * ptdiff.y));
+        std::cout << ", sharpness=" << std::setprecision(2) << ((qside > 0.0) ? (qmax / qside) : 0.0) << std::endl;
+    }
+}
+
+
+static void run_strip_matcher(
+    const std::string& rsimage,
+    const std::string& rstemplate,
+    const double prescale,
+    const int strip_rows)
+{
+    Mat img = imread(rsimage, IMREAD_GRAYSCALE);
+    if (img.empty())
+    {
+        std::cout << "Failed to load image!" << std::endl;
+        ///////
+        return;
+        ///////
+    }
+
+    ghalgo::GradientMatcher matcher;
+    std::shared_ptr<const ghalgo::CompiledTemplate> ptemplate = load_default_template(matcher, rstemplate, prescale);
+    if (!ptemplate)
+    {
+        ///////
+        return;
+        ///////
+    }
+
+    // only the 8-bit image is kept whole
+    // the gradient and vote buffers are sized for a strip
+    Mat img_gray;
+    ghalgo::MatcherContext ctx;
+    ghalgo::GradientMatcher::pre_process(ptemplate->params, img, img_gray);
+    img.release();
+
+    ghalgo::StripResult best;
+    int64_t t0 = getTickCount();
+    ghalgo::GradientMatcher::apply_ghough_strips(*ptemplate, ctx, img_gray, strip_rows,
+        [&best](const ghalgo::StripResult& r)
+    {
+        std::cout << "rows=" << r.row << "-" << (r.row + r.votes.rows - 1);
+        std::cout << ", max=" << r.qmax << " at x=" << r.ptmax.x << ", y=" << r.ptmax.y << std::endl;
+        if (r.qmax > best.qmax)
+        {
+            best.qmax = r.qmax;
+            best.ptmax = r.ptmax;
+        }
+    });
+    int64_t t1 = getTickCount();
+
+    double sec = static_cast<double>(t1 - t0) / getTickFrequency();
+    std::cout << "DONE:  " << std::fixed << std::setprecision(2) << sec << "s, ";
+    std::cout << img_gray.cols << "x" << img_gray.rows << ", best x=" << best.ptmax.x << ", y=" << best.ptmax.y;
+    std::cout << ", score=" << std::setprecision(3) << (best.qmax / ptemplate->max_votes) << std::endl;
+}
+
+
+static void run_stream_matcher(
+    const std::string& rsimage,
+    const std::string& rstemplate,
+    const double prescale,
+    const int push_rows)
+{
+    Mat img = imread(rsimage, IMREAD_COLOR);
+    if (img.empty())
+    {
+        std::cout << "Failed to load image!" << std::endl;
+        ///////
+        return;
+        ///////
+    }
+
+    ghalgo::GradientMatcher matcher;
+    std::shared_ptr<const ghalgo::CompiledTemplate> ptemplate = load_default_template(matcher, rstemplate, prescale);
+    if (!ptemplate)
+    {
+        ///////
+        return;
+        ///////
+    }
+
+    // feed the image to the streaming matcher a few rows at a time like a line-scan camera
+    // the magnitude threshold comes from the first rows that get encoded
+    int ndetections = 0;
+    const int nrows = std::max(1, push_rows);
+    ghalgo::StreamingMatcher streamer;
+    streamer.init(ptemplate, img.cols,
+        [&ndetections](const ghalgo::Detection& r)
+    {
+        std::cout << "row=" << r.row << ", col=" << r.col;
+        std::cout << ", score=" << std::fixed << std::setprecision(3) << r.score << std::endl;
+        ndetections++;
+    }, 0.0, 0.5, 1, nrows);
+
+    int64_t t0 = getTickCount();
+    for (int r0 = 0; r0 < img.rows; r0 += nrows)
+    {
+        streamer.push_rows(img.rowRange(r0, std::min(r0 + nrows, img.rows)));
+    }
+    streamer.flush();
+    int64_t t1 = getTickCount();
+
+    double sec = static_cast<double>(t1 - t0) / getTickFrequency();
+    std::cout << "DONE:  " << std::fixed << std::setprecision(2) << sec << "s, ";
+    std::cout << img.cols << "x" << streamer.get_rows_pushed() << ", " << ndetections << " detections" << std::endl;
+}
+
+
+// Prints time and each hardware event that is being counted.
+static void print_perf_counts(const ghalgo::PerfCounters& rcounters, const ghalgo::PerfCounts& rcounts)
+{
+    // events that cannot be counted on this system are shown as n/a rather than 0
+    std::cout << "time=" << std::fixed << std::setprecision(2) << rcounts.get_msec() << "ms";
+    for (int n = 0; n < ghalgo::PerfCounts::COUNT; ++n)
+    {
+        std::cout << ", " << ghalgo::PerfCounts::get_name(n) << "=";
+        if (rcounters.is_available(n))
+        {
+            std::cout << rcounts.values[n];
+        }
+        else
+        {
+            std::cout << "n/a";
+        }
+    }
+}
+
+
+// Matches a template in an image a number of times and reports hardware counters for each frame.
+// Counters for each stage are also reported when built with GHALGO_PROFILE.
+static void run_profiler(
+    const std::string& rsimage,
+    const std::string& rstemplate,
+    const double prescale,
+    const int frames)
+{
+    Mat img = imread(rsimage, IMREAD_GRAYSCALE);
+    if (img.empty())
+    {
+        std::cout << "Failed to load image!" << std::endl;
+        ///////
+        return;
+        ///////
+    }
+
+    ghalgo::GradientMatcher matcher;
+    std::shared_ptr<const ghalgo::CompiledTemplate> ptemplate = load_default_template(matcher, rstemplate, prescale);
+    if (!ptemplate)
+    {
+        ///////
+        return;
+        ///////
+    }
+
+    ghalgo::MatcherContext ctx;
+    if (!ctx.profiler.enable(true))
+    {
+        std::cout << "PROFILE:  hardware counters are not available so only time is measured" << std::endl;
+    }
+#ifndef GHALGO_PROFILE
+    std::cout << "PROFILE:  build with GHALGO_PROFILE defined for counters for each stage" << std::endl;
+#endif
+
+    // the image is matched in place like a frame from a camera
+    const ghalgo::FrameBuffer frame(img.data, img.cols, img.rows, img.step, ghalgo::FrameBuffer::GRAY8);
+    const ghalgo::PerfCounters& rcounters = ctx.profiler.get_counters();
+    for (int n = 0; n < frames; ++n)
+    {
+        Mat img_grad;
+        Mat img_match;
+        ghalgo::PerfCounts counts;
+        ghalgo::PerfCounts counts0;
+        ctx.profiler.begin_frame();
+        rcounters.read(counts0);
+        ghalgo::GradientMatcher::apply_ghough(*ptemplate, ctx, frame, img_grad, img_match);
+        rcounters.read(counts);
+        counts -= counts0;
+
+        // votes include any that fall outside the image
+        uint64_t votes = ghalgo::count_ghough_votes<uint8_t>(img_grad, ptemplate->table);
+        std::cout << "FRAME " << n << ":  votes=" << votes << ", ";
+        print_perf_counts(rcounters, counts);
+        std::cout << std::endl;
+        for (const auto& rstage : ctx.profiler.get_stages())
+        {
+            std::cout << "  " << std::left << std::setw(8) << rstage.pname << std::right;
+            print_perf_counts(rcounters, rstage.counts);
+            if ((std::string(rstage.pname) == "vote") && (votes > 0) && rcounters.is_available(ghalgo::PerfCounts::CYCLES))
+            {
+                std::cout << ", cycles/vote=" << std::setprecision(2);
+                std::cout << (static_cast<double>(rstage.counts.values[ghalgo::PerfCounts::CYCLES]) / votes);
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+
+// Loads a gray template image from the collection and scales it the same way as when a template is loaded.
+// A message is printed and false is returned if it cannot be loaded.
+static bool load_collection_image(const T_file_info& rinfo, Mat& rimg)
+{
+    bool result = false;
+    Mat img = imread(DATA_PATH + rinfo.sname, IMREAD_GRAYSCALE);
+    if (img.empty())
+    {
+        std::cout << "Failed to load " << rinfo.sname << "!" << std::endl;
+    }
+    else
+    {
+        resize(img, rimg, Size(), rinfo.img_scale, rinfo.img_scale, (rinfo.img_scale > 1.0) ? INTER_CUBIC : INTER_AREA);
+        result = true;
+    }
+    return result;
+}
+
+
+// Writes a set of synthetic scenes made from the templates in the collection.
+// Each scene is saved as <prefix>NNN.png with the ground truth poses in <prefix>NNN.yml.
+static void run_scene_generator(const std::string& rsprefix, const int count, const int seed)
+{
+    // moderately hard scenes for benchmarks
+    ghalgo::SceneSettings settings;
+    settings.size = Size(640, 480);
+    settings.background = 255;
+    settings.ninstances = 3;
+    settings.clutter_density = 1.0;
+    settings.noise_sigma = 6.0;
+    settings.blur_sigma = 1.0;
+    settings.scale_min = 0.9;
+    settings.scale_max = 1.1;
+    settings.angle_max = 10.0;
+
+    ghalgo::SceneGenerator generator;
+    for (const auto& rinfo : vfiles)
+    {
+        Mat img_scaled;
+        if (!load_collection_image(rinfo, img_scaled))
+        {
+            ///////
+            return;
+            ///////
+        }
+        generator.add_template(rinfo.sname, img_scaled);
+    }
+
+    for (int n = 0; n < count; ++n)
+    {
+        Mat img_scene;
+        std::vector<ghalgo::ScenePose> vposes;
+        std::ostringstream oss;
+        oss << rsprefix << std::setfill('0') << std::setw(3) << n;
+
+        // each scene has its own seed so any one of them can be made again by itself
+        generator.generate(settings, static_cast<uint64_t>(seed) + n, img_scene, vposes);
+        if (!imwrite(oss.str() + ".png", img_scene) || !ghalgo::save_scene_poses(oss.str() + ".yml", vposes))
+        {
+            std::cout << "Failed to write " << oss.str() << "!" << std::endl;
+            ///////
+            return;
+            ///////
+        }
+
+        std::cout << oss.str() << ":  " << vposes.size() << " instances" << std::endl;
+    }
+}
+
+
+// Evaluates a grid of matcher settings on scenes written by the scene generator.
+// Writes <output prefix>results.csv and <output prefix>roc.csv and prints the Pareto front.
+static void run_evaluation(const std::string& rsprefix, const int count, const std::string& rsoutput)
+{
+    ghalgo::Evaluator evaluator;
+    for (const auto& rinfo : vfiles)
+    {
+        Mat img_scaled;
+        if (!load_collection_image(rinfo, img_scaled))
+        {
+            ///////
+            return;
+            ///////
+        }
+        evaluator.add_template(rinfo.sname, img_scaled);
+    }
+
+    for (int n = 0; n < count; ++n)
+    {
+        std::vector<ghalgo::ScenePose> vposes;
+        std::ostringstream oss;
+        oss << rsprefix << std::setfill('0') << std::setw(3) << n;
+        Mat img = imread(oss.str() + ".png", IMREAD_GRAYSCALE);
+        if (img.empty() || !ghalgo::load_scene_poses(oss.str() + ".yml", vposes))
+        {
+            std::cout << "Failed to load " << oss.str() << "!" << std::endl;
+            ///////
+            return;
+            ///////
+        }
+        evaluator.add_scene(img, vposes);
+    }
+
+    ghalgo::EvalGrid grid;
+    std::vector<ghalgo::EvalResult> vresults;
+    std::cout << std::fixed;
+    evaluator.evaluate_grid(grid, vresults, [](const ghalgo::EvalResult& r)
+    {
+        std::cout << "step=" << r.loopstep << ", blur=" << r.params.kpreblur << ", sobel=" << r.params.ksobel;
+        std::cout << ", ang=" << std::setprecision(0) << r.params.angstep << ", mag=" << std::setprecision(2) << r.params.magthr;
+        std::cout << ":  det=" << r.detection_rate << ", err=" << std::setprecision(1) << r.loc_error;
+        std::cout << ", fp=" << std::setprecision(2) << r.fp_per_frame << ", time=" << r.msec_per_frame << "ms" << std::endl;
+    });
+
+    std::cout << "PARETO:" << std::endl;
+    for (const auto& r : vresults)
+    {
+        if (r.is_pareto)
+        {
+            std::cout << "  step=" << r.loopstep << ", blur=" << r.params.kpreblur << ", sobel=" << r.params.ksobel;
+            std::cout << ", ang=" << std::setprecision(0) << r.params.angstep << ", mag=" << std::setprecision(2) << r.params.magthr;
+            std::cout << ":  det=" << r.detection_rate << ", fp=" << r.fp_per_frame << ", time=" << r.msec_per_frame << "ms" << std::endl;
+        }
+    }
+
+    if (!ghalgo::save_eval_csv(rsoutput + "results.csv", vresults) || !ghalgo::save_roc_csv(rsoutput + "roc.csv", vresults))
+    {
+        std::cout << "Failed to write results!" << std::endl;
+    }
+}
+
+
+// Checks every voting engine against the reference transform for each template in the collection
+// on synthetic scenes then compares the reference results with a golden file (or writes a new one).
+// Returns true if everything matched.
+static bool run_verifier(const std::string& rsgolden, const bool is_write)
+{
+    ghalgo::VerifySettings settings;
+    std::vector<ghalgo::VerifyResult> vresults;
+    for (const auto& rinfo : vfiles)
+    {
+        Mat img_scaled;
+        if (!load_collection_image(rinfo, img_scaled))
+        {
+            ///////
+            return false;
+            ///////
+        }
+        ghalgo::verify_template(rinfo.sname, img_scaled, settings, vresults);
+    }
+
+    int nmismatches = 0;
+    for (const auto& rresult : vresults)
+    {
+        for (const auto& rsengine : rresult.mismatches)
+        {
+            std::cout << "MISMATCH:  " << rresult.name << ", " << rsengine << std::endl;
+            nmismatches++;
+        }
+    }
+
+    int ndiffs = 0;
+    if (is_write)
+    {
+        if (!ghalgo::save_golden_results(rsgolden, vresults))
+        {
+            std::cout << "Failed to write golden file!" << std::endl;
+            ndiffs++;
+        }
+    }
+    else
+    {
+        std::vector<std::string> vdiffs;
+        std::vector<ghalgo::VerifyResult> vgolden;
+        if (ghalgo::load_golden_results(rsgolden, vgolden))
+        {
+            ndiffs = ghalgo::compare_golden_results(vgolden, vresults, vdiffs);
+            for (const auto& rsdiff : vdiffs)
+            {
+                std::cout << "GOLDEN:  " << rsdiff << std::endl;
+            }
+        }
+        else
+        {
+            std::cout << "Failed to read golden file!" << std::endl;
+            ndiffs++;
+        }
+    }
+
+    std::cout << "VERIFY:  " << vresults.size() << " cases, " << nmismatches << " engine mismatches, ";
+    std::cout << ndiffs << " golden differences" << std::endl;
+    return (nmismatches == 0) && (ndiffs == 0);
+}
+
+
 int main(int argc, char** argv)
 {
-    loop();
-    return 0;
+    int result = 0;
+    if ((argc == 4) && (std::string(argv[1]) == "-compile"))
+    {
+        // CGHMatcher -compile <template dir> <catalog file>
+        run_catalog_compiler(argv[2], argv[3]);
+    }
+    else if ((argc >= 5) && (std::string(argv[1]) == "-video"))
+    {
+        // CGHMatcher -video <video file> <template file> <template scale> [frames in flight]
+        size_t depth = (argc >= 6) ? static_cast<size_t>(atoi(argv[5])) : 0;
+        run_video_matcher(argv[2], argv[3], atof(argv[4]), depth);
+    }
+    else if ((argc == 5) && (std::string(argv[1]) == "-bench"))
+    {
+        // CGHMatcher -bench <image file> <template file> <template scale>
+        run_kernel_benchmark(argv[2], argv[3], atof(argv[4]));
+    }
+    else if ((argc == 5) && (std::string(argv[1]) == "-resbench"))
+    {
+        // CGHMatcher -resbench <image file> <template file> <template scale>
+        run_resolution_benchmark(argv[2], argv[3], atof(argv[4]));
+    }
+    else if ((argc >= 5) && (std::string(argv[1]) == "-profile"))
+    {
+        // CGHMatcher -profile <image file> <template file> <template scale> [frames]
+        int frames = (argc >= 6) ? atoi(argv[5]) : 10;
+        run_profiler(argv[2], argv[3], atof(argv[4]), frames);
+    }
+    else if ((argc >= 5) && (std::string(argv[1]) == "-strips"))
+    {
+        // CGHMatcher -strips <image file> <template file> <template scale> [rows per strip]
+        int strip_rows = (argc >= 6) ? atoi(argv[5]) : 256;
+        run_strip_matcher(argv[2], argv[3], atof(argv[4]), strip_rows);
+    }
+    else if ((argc >= 5) && (std::string(argv[1]) == "-stream"))
+    {
+        // CGHMatcher -stream <image file> <template file> <template scale> [rows per push]
+        int push_rows = (argc >= 6) ? atoi(argv[5]) : 64;
+        run_stream_matcher(argv[2], argv[3], atof(argv[4]), push_rows);
+    }
+    else if ((argc >= 3) && (std::string(argv[1]) == "-gen"))
+    {
+        // CGHMatcher -gen <output prefix> [count=10] [seed=1]
+        int count = (argc >= 4) ? atoi(argv[3]) : 10;
+        int seed = (argc >= 5) ? atoi(argv[4]) : 1;
+        run_scene_generator(argv[2], count, seed);
+    }
+    else if ((argc >= 4) && (std::string(argv[1]) == "-eval"))
+    {
+        // CGHMatcher -eval <scene prefix> <count> [output prefix=eval_]
+        std::string soutput = (argc >= 5) ? argv[4] : "eval_";
+        run_evaluation(argv[2], atoi(argv[3]), soutput);
+    }
+    else if ((argc >= 3) && (std::string(argv[1]) == "-verify"))
+    {
+        // CGHMatcher -verify <golden file> [write]
+        bool is_write = (argc >= 4) && (std::string(argv[3]) == "write");
+        result = (run_verifier(argv[2], is_write)) ? 0 : 1;
+    }
+    else
+    {
+        loop();
+    }
+    return result;
 }